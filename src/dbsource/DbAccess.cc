@@ -12,14 +12,24 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <set>
+#include <cstring>
+#include <unistd.h>
 
 #include "zypp/base/Logger.h"
+#include "zypp/base/String.h"
 #include "zypp/ZYppFactory.h"
 #include "zypp/Source.h"
 #include "zypp/detail/ImplConnect.h"
 #include "zypp/source/PackageDelta.h"
 #include "zypp/capability/Capabilities.h"
 #include "DbAccess.h"
+#include "DbDependencyBlob.h"
+#include "DbPackedText.h"
+#include "DbRecordQueue.h"
+#include "DbRowSchema.h"
+#include "DbStatementCache.h"
 
 IMPL_PTR_TYPE(DbAccess);
 
@@ -57,6 +67,20 @@ archtable[] = {
 
 //----------------------------------------------------------------------------
 
+static bool
+exec_sql( sqlite3 *db, const string & sql )
+{
+  char *errmsg = NULL;
+  if (sqlite3_exec (db, sql.c_str(), NULL, NULL, &errmsg) != SQLITE_OK)
+  {
+    ERR << "'" << sql << "' failed: " << (errmsg ? errmsg : "") << endl;
+    sqlite3_free (errmsg);
+    return false;
+  }
+  return true;
+}
+
+
 // check if source is local for zypp
 
 static bool
@@ -194,12 +218,39 @@ DbAccess::Rc2Arch (RCArch rc)
 }
 
 
+// check schema for column, used to detect backend additions to zmd tables
+
+bool
+DbAccess::haveColumn( sqlite3 *db, const std::string & table, const std::string & column )
+{
+  string query( "PRAGMA table_info(" + table + ")" );
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare (db, query.c_str(), -1, &handle, NULL) != SQLITE_OK)
+  {
+    ERR << "Can not prepare '" << query << "': " << sqlite3_errmsg (db) << endl;
+    return false;
+  }
+
+  bool found = false;
+  while (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    const char *name = (const char *) sqlite3_column_text( handle, 1 );	// cid, name, type, ...
+    if (name != NULL && column == name)
+    {
+      found = true;
+      break;
+    }
+  }
+  sqlite3_finalize( handle );
+  return found;
+}
+
+
 // remove Authors from description Text
 static string
 desc2str (const Text t)
 {
-  static string s;		// static so we can use sqlite STATIC below
-  s.clear();
+  string s;
   string::size_type authors = t.find ("Authors:");		// strip off 'Authors:'
 
   if (authors == string::npos)
@@ -237,8 +288,7 @@ kind2target( Resolvable::Kind kind )
   else if (kind == ResTraits<SrcPackage>::kind) return RC_DEP_TARGET_SRC;
   else if (kind == ResTraits<SystemResObject>::kind) return RC_DEP_TARGET_SYSTEM;
 
-  WAR << "Unknown resolvable kind " << kind << endl;
-  return RC_DEP_TARGET_UNKNOWN;
+  return RC_DEP_TARGET_UNKNOWN;		// no logging, runs on the record producer thread
 }
 
 //----------------------------------------------------------------------------
@@ -253,6 +303,154 @@ resstatus2rcstatus( ResStatus status )
   return RC_RES_STATUS_UNDETERMINED;
 }
 
+//----------------------------------------------------------------------------
+// identity and content of a resolvable, as needed for syncStore()
+
+// key matching a resolvables row: kind, name, edition and arch as stored in the db
+
+static string
+resobject_key( int kind, const string & name, const string & version, const string & release, int epoch, int arch )
+{
+  ostringstream os;
+  os << kind << '|' << name << '|' << epoch << '|' << version << '|' << release << '|' << arch;
+  return os.str();
+}
+
+static string
+resobject_key( ResObject::constPtr obj )
+{
+  Edition ed = obj->edition();
+  return resobject_key( kind2target( obj->kind() ),
+                        obj->name(),
+                        ed.version(),
+                        ed.release(),
+                        (ed.epoch() == Edition::noepoch) ? 0 : ed.epoch(),
+                        DbAccess::Arch2Rc( obj->arch() ) );
+}
+
+// 64bit FNV-1a hash
+
+static sqlite_int64
+fnv1a( const string & s )
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  for (string::const_iterator it = s.begin(); it != s.end(); ++it)
+  {
+    hash ^= (unsigned char)*it;
+    hash *= 1099511628211ULL;
+  }
+  return (sqlite_int64)hash;
+}
+
+// script files of a Script, see read_script()
+
+struct ScriptText
+{
+  string do_path;
+  string undo_path;
+  string do_text;
+  string undo_text;
+};
+
+// hash over everything writeResObject() puts into the db for this object
+//  if two objects with the same key have the same fingerprint, the rows
+//  would be identical and rewriting them can be skipped
+//  A Script hashes the paths in script if given, its own ones otherwise.
+
+static sqlite_int64
+resobject_fingerprint( ResObject::constPtr obj, ResStatus status, Ownership owner, const ScriptText *script_text = NULL )
+{
+  ostringstream os;
+
+  os << resobject_key( obj ) << '\n'
+     << obj->size() << '|' << (status.isInstalled() ? 1 : 0) << '|' << resstatus2rcstatus( status ) << '|' << owner << '\n';
+
+  Resolvable::constPtr res = obj;
+  RCDependencyTarget kind = kind2target( obj->kind() );
+
+  // an installed package only changes by being reinstalled, its install
+  //  time tells, no need to hash the rpm header data
+  if (status.isInstalled()
+      && kind == RC_DEP_TARGET_PACKAGE)
+  {
+    os << "installed|" << obj->installtime() << '\n';
+    return fnv1a( os.str() );
+  }
+  switch (kind)		// dispatch once, the casts can be static
+  {
+    case RC_DEP_TARGET_PACKAGE:
+    {
+      Package::constPtr pkg = static_pointer_cast<const Package>( obj );
+      os << pkg->licenseToConfirm() << '|' << pkg->group() << '|' << pkg->summary() << '|' << pkg->description() << '|'
+         << pkg->location().asString() << '|' << pkg->installOnly() << '|' << pkg->sourceMediaNr() << '\n';
+
+      detail::ResImplTraits<Package::Impl>::constPtr pipp( detail::ImplConnect::resimpl( pkg ) );
+      std::list<DeltaRpm> deltas = pipp->deltaRpms();
+      for ( std::list<DeltaRpm>::const_iterator it = deltas.begin(); it != deltas.end(); ++it )
+      {
+        os << "delta|" << it->location().filename().asString() << '|' << it->location().checksum().checksum() << '\n';
+      }
+      std::list<PatchRpm> patches = pipp->patchRpms();
+      for ( std::list<PatchRpm>::const_iterator it = patches.begin(); it != patches.end(); ++it )
+      {
+        os << "patch|" << it->location().filename().asString() << '|' << it->location().checksum().checksum() << '\n';
+      }
+      break;
+    }
+    case RC_DEP_TARGET_MESSAGE:
+    {
+      Message::constPtr message = static_pointer_cast<const Message>( obj );
+      os << message->text().asString() << '\n';
+      break;
+    }
+    case RC_DEP_TARGET_SCRIPT:
+    {
+      Script::constPtr script = static_pointer_cast<const Script>( obj );
+      if (script_text != NULL)
+        os << script_text->do_path << '|' << script_text->undo_path << '\n';
+      else
+        os << script->do_script().asString() << '|' << script->undo_script().asString() << '\n';
+      break;
+    }
+    case RC_DEP_TARGET_PATCH:
+    {
+      Patch::constPtr patch = static_pointer_cast<const Patch>( obj );
+      os << patch->id() << '|' << patch->timestamp() << '|' << patch->reboot_needed() << '|' << patch->affects_pkg_manager() << '|'
+         << patch->category() << '|' << patch->licenseToConfirm() << '|' << patch->summary() << '|' << patch->description() << '\n';
+      break;
+    }
+    case RC_DEP_TARGET_PATTERN:
+    {
+      Pattern::constPtr pattern = static_pointer_cast<const Pattern>( obj );
+      os << pattern->summary() << '|' << pattern->description() << '\n';
+      break;
+    }
+    case RC_DEP_TARGET_PRODUCT:
+    {
+      Product::constPtr product = static_pointer_cast<const Product>( obj );
+      os << product->category() << '|' << product->licenseToConfirm() << '|' << product->summary() << '|' << product->description() << '\n';
+      break;
+    }
+    default:
+      break;
+  }
+
+  const Dep deptypes[] = { Dep::REQUIRES, Dep::PROVIDES, Dep::CONFLICTS, Dep::OBSOLETES, Dep::PREREQUIRES,
+                           Dep::FRESHENS, Dep::RECOMMENDS, Dep::SUGGESTS, Dep::SUPPLEMENTS, Dep::ENHANCES };
+  for (unsigned i = 0; i < sizeof(deptypes)/sizeof(deptypes[0]); ++i)
+  {
+    const CapSet & caps( res->dep( deptypes[i] ) );
+    os << i << ':';
+    for (CapSet::const_iterator it = caps.begin(); it != caps.end(); ++it)
+    {
+      os << it->refers() << '|' << it->asString() << ',';
+    }
+    os << '\n';
+  }
+
+  return fnv1a( os.str() );
+}
+
 //----------------------------------------------------------------------------
 
 /** Ctor */
@@ -260,19 +458,34 @@ DbAccess::DbAccess( const std::string & dbfile_r )
     : _dbfile( dbfile_r )
     , _db( NULL )
     , _insert_res_handle( NULL )
-    , _insert_pkg_handle( NULL )
     , _insert_patch_package_handle(0L)
     , _insert_patch_package_baseversion_handle(0L)
     , _insert_delta_package_handle(0L)
-    , _insert_message_handle( NULL )
-    , _insert_script_handle( NULL )
-    , _insert_patch_handle( NULL )
-    , _insert_pattern_handle( NULL )
-    , _insert_product_handle( NULL )
-    , _insert_dep_handle( NULL )
     , _update_catalog_checksum_handle( NULL )
+    , _insert_fingerprint_handle( NULL )
+    , _delete_res_handle( NULL )
+    , _intern_dep_names( false )
+    , _select_dep_name_handle( NULL )
+    , _insert_dep_name_handle( NULL )
+    , _share_dep_sets( false )
+    , _select_dep_set_handle( NULL )
+    , _insert_dep_set_handle( NULL )
+    , _insert_res_dep_set_handle( NULL )
+    , _pack_deps( false )
+    , _insert_dep_blob_handle( NULL )
+    , _split_file_provides( false )
+    , _insert_file_provide_handle( NULL )
+    , _insert_file_require_handle( NULL )
+    , _staging( false )
+    , _bulk_threshold( DEFAULT_BULK_LOAD_THRESHOLD )
+    , _bulk_load( false )
+    , _chunk_size( 0 )
+    , _report_progress( false )
+    , _pack_text( false )
 {
   MIL << "DbAccess::DbAccess(" << dbfile_r << ")" << endl;
+  for (int details = 0; details < DbResRecord::DETAILS_COUNT; ++details)
+    _insert_details_handles[details] = NULL;
 }
 
 
@@ -311,173 +524,414 @@ prepare_handle( sqlite3 *db, const string & query )
 }
 
 
+//----------------------------------------------------------------------------
+// rows written from records, see DbRowSchema.h
+
+static const DbColumn<DbResRecord> resolvable_columns[] = {
+  { "name",		bind_text<DbResRecord, &DbResRecord::name> },
+  { "version",		bind_text<DbResRecord, &DbResRecord::version> },
+  { "release",		bind_text<DbResRecord, &DbResRecord::release> },
+  { "epoch",		bind_int<DbResRecord, &DbResRecord::epoch> },
+  { "arch",		bind_int<DbResRecord, &DbResRecord::arch> },
+  { "installed_size",	bind_int64<DbResRecord, &DbResRecord::size> },
+  { "catalog",		bind_text<DbResRecord, &DbResRecord::catalog> },
+  { "installed",	bind_bool<DbResRecord, &DbResRecord::installed> },
+  { "local",		bind_bool<DbResRecord, &DbResRecord::local> },
+  { "status",		bind_int<DbResRecord, &DbResRecord::status> },
+  { "category",		bind_optional_text<DbResRecord, &DbResRecord::category, &DbResRecord::have_category> },
+  { "license",		bind_optional_text<DbResRecord, &DbResRecord::license, &DbResRecord::have_license> },
+  { "kind",		bind_int<DbResRecord, &DbResRecord::kind> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbResRecord> resolvable_schema = { "resolvables", NULL, resolvable_columns };
+
+static const DbColumn<DbResRecord> package_columns[] = {
+  { "rpm_group",	bind_text<DbResRecord, &DbResRecord::group> },
+  { "summary",		bind_packed_text<DbResRecord, &DbResRecord::summary, &DbResRecord::summary_packed> },
+  { "description",	bind_packed_text<DbResRecord, &DbResRecord::description, &DbResRecord::description_packed> },
+  { "package_url",	bind_optional_text<DbResRecord, &DbResRecord::url, &DbResRecord::have_url> },
+  { "package_filename",	bind_optional_text<DbResRecord, &DbResRecord::filename, &DbResRecord::have_filename> },
+  { "signature_filename", bind_null<DbResRecord> },
+  { "file_size",	bind_int<DbResRecord, &DbResRecord::package_size> },
+  { "install_only",	bind_bool<DbResRecord, &DbResRecord::install_only> },
+  { "media_nr",		bind_int<DbResRecord, &DbResRecord::media_nr> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbResRecord> package_schema = { "package_details", "resolvable_id", package_columns };
+
+static const DbColumn<DbResRecord> message_columns[] = {
+  { "content",		bind_text<DbResRecord, &DbResRecord::text> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbResRecord> message_schema = { "message_details", "resolvable_id", message_columns };
+
+static const DbColumn<DbResRecord> script_columns[] = {
+  { "do_script",	bind_text<DbResRecord, &DbResRecord::text> },
+  { "undo_script",	bind_text<DbResRecord, &DbResRecord::undo_text> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbResRecord> script_schema = { "script_details", "resolvable_id", script_columns };
+
+static const DbColumn<DbResRecord> patch_columns[] = {
+  { "patch_id",		bind_text<DbResRecord, &DbResRecord::patch_id> },
+  { "creation_time",	bind_int64<DbResRecord, &DbResRecord::timestamp> },
+  { "reboot",		bind_bool<DbResRecord, &DbResRecord::reboot_needed> },
+  { "restart",		bind_bool<DbResRecord, &DbResRecord::affects_pkg_manager> },
+  { "summary",		bind_packed_text<DbResRecord, &DbResRecord::summary, &DbResRecord::summary_packed> },
+  { "description",	bind_packed_text<DbResRecord, &DbResRecord::description, &DbResRecord::description_packed> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbResRecord> patch_schema = { "patch_details", "resolvable_id", patch_columns };
+
+// pattern_details and product_details
+static const DbColumn<DbResRecord> text_columns[] = {
+  { "summary",		bind_packed_text<DbResRecord, &DbResRecord::summary, &DbResRecord::summary_packed> },
+  { "description",	bind_packed_text<DbResRecord, &DbResRecord::description, &DbResRecord::description_packed> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbResRecord> pattern_schema = { "pattern_details", "resolvable_id", text_columns };
+static const DbRowSchema<DbResRecord> product_schema = { "product_details", "resolvable_id", text_columns };
+
+// _details table of each DbResRecord::Details
+static const DbRowSchema<DbResRecord> *details_schemas[DbResRecord::DETAILS_COUNT] = {
+  NULL,				// NO_DETAILS
+  &package_schema,
+  &message_schema,
+  &script_schema,
+  &patch_schema,
+  &pattern_schema,
+  &product_schema
+};
+
+static const DbColumn<DbPatchRpmRecord> patch_rpm_columns[] = {
+  { "media_nr",		bind_int<DbPatchRpmRecord, &DbPatchRpmRecord::media_nr> },
+  { "location",		bind_text<DbPatchRpmRecord, &DbPatchRpmRecord::location> },
+  { "checksum",		bind_text<DbPatchRpmRecord, &DbPatchRpmRecord::checksum> },
+  { "download_size",	bind_int<DbPatchRpmRecord, &DbPatchRpmRecord::download_size> },
+  { "build_time",	bind_int<DbPatchRpmRecord, &DbPatchRpmRecord::build_time> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbPatchRpmRecord> patch_rpm_schema = { "patch_packages", "package_id", patch_rpm_columns };
+
+static const DbColumn<DbBaseVersionRecord> baseversion_columns[] = {
+  { "version",		bind_text<DbBaseVersionRecord, &DbBaseVersionRecord::version> },
+  { "release",		bind_text<DbBaseVersionRecord, &DbBaseVersionRecord::release> },
+  { "epoch",		bind_int<DbBaseVersionRecord, &DbBaseVersionRecord::epoch> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbBaseVersionRecord> baseversion_schema = { "patch_packages_baseversions", "patch_package_id", baseversion_columns };
+
+static const DbColumn<DbDeltaRecord> delta_columns[] = {
+  { "media_nr",		bind_int<DbDeltaRecord, &DbDeltaRecord::media_nr> },
+  { "location",		bind_text<DbDeltaRecord, &DbDeltaRecord::location> },
+  { "checksum",		bind_text<DbDeltaRecord, &DbDeltaRecord::checksum> },
+  { "download_size",	bind_int<DbDeltaRecord, &DbDeltaRecord::download_size> },
+  { "build_time",	bind_int<DbDeltaRecord, &DbDeltaRecord::build_time> },
+  { "baseversion_version", bind_text<DbDeltaRecord, &DbDeltaRecord::base_version> },
+  { "baseversion_release", bind_text<DbDeltaRecord, &DbDeltaRecord::base_release> },
+  { "baseversion_epoch", bind_int<DbDeltaRecord, &DbDeltaRecord::base_epoch> },
+  { "baseversion_checksum", bind_text<DbDeltaRecord, &DbDeltaRecord::base_checksum> },
+  { "baseversion_build_time", bind_int<DbDeltaRecord, &DbDeltaRecord::base_build_time> },
+  { "baseversion_sequence_info", bind_text<DbDeltaRecord, &DbDeltaRecord::base_sequence_info> },
+  { NULL, NULL }
+};
+static const DbRowSchema<DbDeltaRecord> delta_schema = { "delta_packages", "package_id", delta_columns };
+
+template <class R>
 static sqlite3_stmt *
-prepare_res_insert (sqlite3 *db)
+prepare_row_insert( sqlite3 *db, const DbRowSchema<R> & schema )
 {
-  string query (
-    //			  1     2        3        4      5
-    "INSERT INTO resolvables (name, version, release, epoch, arch,"
-    //			  6               7
-    "                         installed_size, catalog,"
-    //			  8          9      10      11        12       13
-    "                         installed, local, status, category, license, kind) "
-    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
-
-  return prepare_handle( db, query );
+  return prepare_handle( db, row_insert( schema ) );
 }
 
+// insert row of schema with handle (from prepare_row_insert())
+//  return rowid (> 0) on success
+//  return < 0 on failure
 
-static sqlite3_stmt *
-prepare_message_insert (sqlite3 *db)
+template <class R>
+static sqlite_int64
+insert_row( sqlite3 *db, sqlite3_stmt *handle, const DbRowSchema<R> & schema, sqlite_int64 owner, const R & row )
 {
-  string query (
-    //			      1
-    "INSERT INTO message_details (resolvable_id, "
-    //			      2
-    "                             content) "
-    "VALUES (?, ?)"
-    "");
+  bind_row( handle, schema, owner, row );
 
-  return prepare_handle( db, query );
-}
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
 
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error adding " << schema.table << " row to SQL: " << sqlite3_errmsg (db) << endl;
+    return -1;
+  }
+  return sqlite3_last_insert_rowid (db);
+}
 
 static sqlite3_stmt *
-prepare_script_insert (sqlite3 *db)
+prepare_catalog_checksum_update(sqlite3 *db)
 {
   string query (
-    //			      1
-    "INSERT INTO script_details (resolvable_id, "
-    //			      2          3
-    "                             do_script, undo_script) "
-    "VALUES (?, ?, ?)"
-    "");
-
+    "UPDATE catalogs "
+    "SET checksum =?, timestamp =? WHERE id=?");
   return prepare_handle( db, query );
 }
 
-
 static sqlite3_stmt *
-prepare_pkg_insert (sqlite3 *db)
+prepare_fingerprint_insert (sqlite3 *db)
 {
   string query (
-    //			      1              2          3
-    "INSERT INTO package_details (resolvable_id, rpm_group, summary, "
-    //			      4            5		6                 7
-    "                             description, package_url, package_filename, signature_filename,"
-    //			      8	         9             10
-    "                             file_size, install_only, media_nr) "
-    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
-    "");
+    //                                    1              2
+    "INSERT INTO resolvable_fingerprints (resolvable_id, fingerprint) "
+    "VALUES (?, ?)");
 
   return prepare_handle( db, query );
 }
 
-
 static sqlite3_stmt *
-prepare_patch_insert (sqlite3 *db)
+prepare_dep_name_select (sqlite3 *db)
 {
-  string query (
-    //			    1              2
-    "INSERT INTO patch_details (resolvable_id, patch_id, "
-    //			    3
-    "                           creation_time,"
-    //			    4       5        6
-    "                           reboot, restart,"
-    //			    7        8
-    "                           summary, description) "
-    "VALUES (?, ?, ?, ?, ?, ?, ?)"
-    "");
+  string query ("SELECT id FROM dep_names WHERE name = ?");
 
   return prepare_handle( db, query );
 }
 
-
 static sqlite3_stmt *
-prepare_pattern_insert (sqlite3 *db)
+prepare_dep_name_insert (sqlite3 *db)
 {
-  string query (
-    //			      1
-    "INSERT INTO pattern_details (resolvable_id, "
-    //			      2        3
-    "                             summary, description) "
-    "VALUES (?, ?, ?)"
-    "");
+  string query ("INSERT INTO dep_names (name) VALUES (?)");
 
   return prepare_handle( db, query );
 }
 
-
 static sqlite3_stmt *
-prepare_product_insert (sqlite3 *db)
+prepare_dep_set_select (sqlite3 *db)
 {
-  string query (
-    //			      1
-    "INSERT INTO product_details (resolvable_id, "
-    //			      2        3
-    "                             summary, description) "
-    "VALUES (?, ?, ?)"
-    "");
+  string query ("SELECT id FROM dependency_sets WHERE hash = ?");
 
   return prepare_handle( db, query );
 }
 
 static sqlite3_stmt *
-prepare_patch_package_insert( sqlite3 *db )
+prepare_dep_set_insert (sqlite3 *db)
 {
-  string query(
-    "INSERT INTO patch_packages "
-    //  1           2         3         4         5              6
-    " ( package_id, media_nr, location, checksum, download_size, build_time ) "
-    " VALUES (?, ?, ?, ?, ?, ?)");
+  string query ("INSERT INTO dependency_sets (hash) VALUES (?)");
+
   return prepare_handle( db, query );
 }
 
 static sqlite3_stmt *
-prepare_patch_package_baseversion_insert( sqlite3 *db )
+prepare_res_dep_set_insert (sqlite3 *db)
 {
-  string query(
-    "INSERT INTO patch_packages_baseversions "
-    //  1                   2         3         4
-    " ( patch_package_id, version, release, epoch ) "
-    " VALUES (?, ?, ?, ?)");
+  string query (
+    //                                 1              2
+    "INSERT INTO resolvable_dep_sets (resolvable_id, dep_set_id) "
+    "VALUES (?, ?)");
+
   return prepare_handle( db, query );
 }
 
 static sqlite3_stmt *
-prepare_delta_package_insert( sqlite3 *db )
-{
-  string query(
-    "INSERT INTO delta_packages "
-    //    1           2         3         4         5              6
-    " ( package_id, media_nr, location, checksum, download_size, build_time"
-    //    7                     8                     9                     10                  11                    12
-    "  , baseversion_version, baseversion_release, baseversion_epoch, baseversion_checksum, baseversion_build_time, baseversion_sequence_info ) "
-    " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+prepare_dep_blob_insert (sqlite3 *db)
+{
+  string query (
+    //                                  1              2
+    "INSERT INTO resolvable_dep_blobs (resolvable_id, deps) "
+    "VALUES (?, ?)");
+
   return prepare_handle( db, query );
 }
 
 static sqlite3_stmt *
-prepare_dep_insert (sqlite3 *db)
+prepare_file_dependency_insert (sqlite3 *db, const char *table)
 {
-  string query (
-    "INSERT INTO dependencies "
-    //  1              2         3     4        5        6      7     8         9
-    "  (resolvable_id, dep_type, name, version, release, epoch, arch, relation, dep_target) "
-    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
+  //                            1              2     3
+  string query( string( "INSERT INTO " ) + table + " (resolvable_id, name, dep_target) VALUES (?, ?, ?)" );
 
   return prepare_handle( db, query );
 }
 
 static sqlite3_stmt *
-prepare_catalog_checksum_update(sqlite3 *db)
+prepare_res_delete (sqlite3 *db)
 {
-  string query (
-    "UPDATE catalogs "
-    "SET checksum =?, timestamp =? WHERE id=?");
+  // details and dependencies are removed by the triggers on resolvables
+  string query ("DELETE FROM resolvables WHERE id = ?");
+
   return prepare_handle( db, query );
 }
-    
+
+//----------------------------------------------------------------------------
+// tables owned by the backend (zmd creates and owns the rest of the schema)
+
+static const char *backend_schema[] = {
+  // content fingerprint of each resolvable, see syncStore()
+  "CREATE TABLE IF NOT EXISTS resolvable_fingerprints ("
+  "  resolvable_id INTEGER PRIMARY KEY,"
+  "  fingerprint INTEGER NOT NULL)",
+  "CREATE TRIGGER IF NOT EXISTS remove_resolvable_fingerprints AFTER DELETE ON resolvables"
+  "  BEGIN DELETE FROM resolvable_fingerprints WHERE resolvable_id = old.id; END",
+  // dictionary of dependency names, see DbAccess::depNameId()
+  "CREATE TABLE IF NOT EXISTS dep_names ("
+  "  id INTEGER PRIMARY KEY,"
+  "  name TEXT NOT NULL UNIQUE)",
+  // dependencies shared by resolvables with equal dependency sets, see DbAccess::depSetId()
+  "CREATE TABLE IF NOT EXISTS dependency_sets ("
+  "  id INTEGER PRIMARY KEY,"
+  "  hash INTEGER NOT NULL UNIQUE)",
+  "CREATE TABLE IF NOT EXISTS dependency_set_rows ("
+  "  id INTEGER PRIMARY KEY,"
+  "  dep_set_id INTEGER NOT NULL,"
+  "  dep_type INTEGER,"
+  "  name VARCHAR,"
+  "  version VARCHAR,"
+  "  release VARCHAR,"
+  "  epoch INTEGER,"
+  "  arch INTEGER,"
+  "  relation INTEGER,"
+  "  dep_target INTEGER,"
+  "  name_id INTEGER)",
+  "CREATE INDEX IF NOT EXISTS dependency_set_rows_set_index ON dependency_set_rows (dep_set_id)",
+  "CREATE TRIGGER IF NOT EXISTS remove_dependency_set_rows AFTER DELETE ON dependency_sets"
+  "  BEGIN DELETE FROM dependency_set_rows WHERE dep_set_id = old.id; END",
+  "CREATE TABLE IF NOT EXISTS resolvable_dep_sets ("
+  "  resolvable_id INTEGER PRIMARY KEY,"
+  "  dep_set_id INTEGER NOT NULL)",
+  "CREATE INDEX IF NOT EXISTS resolvable_dep_sets_set_index ON resolvable_dep_sets (dep_set_id)",
+  "CREATE TRIGGER IF NOT EXISTS remove_resolvable_dep_sets AFTER DELETE ON resolvables"
+  "  BEGIN DELETE FROM resolvable_dep_sets WHERE resolvable_id = old.id; END",
+  // all dependencies of a resolvable packed into one blob, see DbDependencyBlob.h
+  "CREATE TABLE IF NOT EXISTS resolvable_dep_blobs ("
+  "  resolvable_id INTEGER PRIMARY KEY,"
+  "  deps BLOB NOT NULL)",
+  "CREATE TRIGGER IF NOT EXISTS remove_resolvable_dep_blobs AFTER DELETE ON resolvables"
+  "  BEGIN DELETE FROM resolvable_dep_blobs WHERE resolvable_id = old.id; END",
+  // unversioned file provides, kept out of the dependencies, see DbAccess::splitFileDependencies()
+  "CREATE TABLE IF NOT EXISTS file_provides ("
+  "  resolvable_id INTEGER NOT NULL,"
+  "  name TEXT NOT NULL,"
+  "  dep_target INTEGER NOT NULL)",
+  "CREATE INDEX IF NOT EXISTS file_provides_resolvable_index ON file_provides (resolvable_id)",
+  "CREATE INDEX IF NOT EXISTS file_provides_name_index ON file_provides (name)",
+  "CREATE TRIGGER IF NOT EXISTS remove_file_provides AFTER DELETE ON resolvables"
+  "  BEGIN DELETE FROM file_provides WHERE resolvable_id = old.id; END",
+  // paths of file requires, also in the dependencies, select the file provides to read
+  "CREATE TABLE IF NOT EXISTS file_requires ("
+  "  resolvable_id INTEGER NOT NULL,"
+  "  name TEXT NOT NULL,"
+  "  dep_target INTEGER NOT NULL)",
+  "CREATE INDEX IF NOT EXISTS file_requires_resolvable_index ON file_requires (resolvable_id)",
+  "CREATE INDEX IF NOT EXISTS file_requires_name_index ON file_requires (name)",
+  "CREATE TRIGGER IF NOT EXISTS remove_file_requires AFTER DELETE ON resolvables"
+  "  BEGIN DELETE FROM file_requires WHERE resolvable_id = old.id; END",
+  // catalogs kept in a db file of their own, see DbAccess::openShard()
+  "CREATE TABLE IF NOT EXISTS catalog_shards ("
+  "  id INTEGER PRIMARY KEY,"
+  "  catalog TEXT NOT NULL UNIQUE,"
+  "  file TEXT NOT NULL)",
+  // resolvables.id range of each catalog, see DbAccess::updateCatalogRange()
+  "CREATE TABLE IF NOT EXISTS catalog_ranges ("
+  "  catalog TEXT PRIMARY KEY,"
+  "  first_id INTEGER NOT NULL,"
+  "  last_id INTEGER NOT NULL,"
+  "  count INTEGER NOT NULL)",
+  // top resolvables row when the ranges were recorded, see DbAccess::catalogRangesValid()
+  "CREATE TABLE IF NOT EXISTS catalog_ranges_top ("
+  "  id INTEGER NOT NULL,"
+  "  catalog TEXT NOT NULL)",
+  // catalog holding the resolvables of each catalog, see DbAccess::shareCatalog()
+  "CREATE TABLE IF NOT EXISTS catalog_content ("
+  "  catalog TEXT PRIMARY KEY,"
+  "  content TEXT NOT NULL,"
+  "  owner INTEGER NOT NULL)",
+  "CREATE INDEX IF NOT EXISTS catalog_content_content_index ON catalog_content (content)",
+  // indexes dropped by a bulk load, see DbAccess::beginBulkLoad()
+  "CREATE TABLE IF NOT EXISTS bulk_load_indexes ("
+  "  name TEXT PRIMARY KEY,"
+  "  sql TEXT NOT NULL)",
+  NULL
+};
+
+static bool
+index_exists( sqlite3 *db, const string & name )
+{
+  sqlite3_stmt *handle = prepare_handle( db, "SELECT 1 FROM main.sqlite_master WHERE type = 'index' AND name = ?" );
+  if (handle == NULL)
+    return false;
+  sqlite3_bind_text( handle, 1, name.c_str(), -1, SQLITE_STATIC );
+  bool result = (sqlite3_step( handle ) == SQLITE_ROW);
+  sqlite3_finalize( handle );
+  return result;
+}
+
+
+// recreate indexes a bulk load dropped and could not restore (crashed between chunk commits)
+
+static void
+restore_bulk_indexes( sqlite3 *db )
+{
+  vector<pair<string, string> > indexes;
+  sqlite3_stmt *handle = prepare_handle( db, "SELECT name, sql FROM bulk_load_indexes" );
+  if (handle == NULL)
+    return;
+  while (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    indexes.push_back( make_pair( string( (const char *) sqlite3_column_text( handle, 0 ) ),
+                                  string( (const char *) sqlite3_column_text( handle, 1 ) ) ) );
+  }
+  sqlite3_finalize( handle );
+
+  for (vector<pair<string, string> >::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
+  {
+    if (index_exists( db, it->first ))
+      continue;
+    WAR << "Restoring index " << it->first << " of unfinished bulk load" << endl;
+    if (sqlite3_exec (db, it->second.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+      ERR << "Can not restore index " << it->first << ": " << sqlite3_errmsg (db) << endl;
+  }
+  if (!indexes.empty())
+    sqlite3_exec (db, "DELETE FROM bulk_load_indexes", NULL, NULL, NULL);
+}
+
+
+bool
+DbAccess::prepareSchema(void)
+{
+  XXX << "DbAccess::prepareSchema()" << endl;
+
+  for (const char **ddl = backend_schema; *ddl != NULL; ++ddl)
+  {
+    char *errmsg = NULL;
+    if (sqlite3_exec (_db, *ddl, NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+      ERR << "Can not create '" << *ddl << "': " << (errmsg ? errmsg : "") << endl;
+      sqlite3_free (errmsg);
+      return false;
+    }
+  }
+
+  // dependencies rows carry either name (zmd) or name_id (interned)
+  //  zmd's table is only altered if names are interned
+
+  if (_intern_dep_names)
+  {
+    if (!haveColumn( _db, "dependencies", "name_id" ))
+    {
+      MIL << "Adding dependencies.name_id" << endl;
+      if (sqlite3_exec (_db, "ALTER TABLE dependencies ADD COLUMN name_id INTEGER", NULL, NULL, NULL) != SQLITE_OK)
+      {
+        ERR << "Can not add dependencies.name_id: " << sqlite3_errmsg (_db) << endl;
+        return false;
+      }
+    }
+    sqlite3_exec (_db, "CREATE INDEX IF NOT EXISTS dependency_name_id_index ON dependencies (name_id)", NULL, NULL, NULL);
+  }
+
+  // ranges were kept up to date by a per-row trigger once, zmd paid for it
+  sqlite3_exec (_db, "DROP TRIGGER IF EXISTS invalidate_catalog_ranges", NULL, NULL, NULL);
+  if (!catalogRangesValid( _db ))
+    rebuildCatalogRanges();
+
+  restore_bulk_indexes( _db );
+  return true;
+}
+
 bool
 DbAccess::prepareWrite(void)
 {
@@ -485,81 +939,130 @@ DbAccess::prepareWrite(void)
 
   sqlite3_exec (_db, "PRAGMA synchronous = 0", NULL, NULL, NULL);
 
+  if (!prepareSchema()
+      || !prepareHandles())
+  {
+    closeDb();
+    return false;
+  }
+  return true;
+}
+
+
+// prepare all write statements, table names resolve to the staging tables while staging
+
+bool
+DbAccess::prepareHandles(void)
+{
   bool result = false;
 
-  _insert_res_handle = prepare_res_insert (_db);
+  _insert_res_handle = prepare_row_insert( _db, resolvable_schema );
   if (_insert_res_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_pkg_handle = prepare_pkg_insert (_db);
-  if (_insert_pkg_handle == NULL)
+  for (int details = 0; details < DbResRecord::DETAILS_COUNT; ++details)
   {
-    goto cleanup;
+    if (details_schemas[details] == NULL)
+      continue;
+    _insert_details_handles[details] = prepare_row_insert( _db, *details_schemas[details] );
+    if (_insert_details_handles[details] == NULL)
+    {
+      goto cleanup;
+    }
   }
 
-  _insert_patch_package_handle = prepare_patch_package_insert (_db);
+  _insert_patch_package_handle = prepare_row_insert( _db, patch_rpm_schema );
   if (_insert_patch_package_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_patch_package_baseversion_handle = prepare_patch_package_baseversion_insert (_db);
+  _insert_patch_package_baseversion_handle = prepare_row_insert( _db, baseversion_schema );
   if (_insert_patch_package_baseversion_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_delta_package_handle = prepare_delta_package_insert (_db);
+  _insert_delta_package_handle = prepare_row_insert( _db, delta_schema );
   if (_insert_delta_package_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_patch_package_handle = prepare_patch_package_insert (_db);
-  if (_insert_patch_package_handle == NULL)
+  if (!_dep_writer.prepare (_db, "dependencies", "resolvable_id", haveColumn( _db, "dependencies", "name_id" )))	// left from an interning run
+  {
+    goto cleanup;
+  }
+
+  if (!_dep_set_writer.prepare (_db, "dependency_set_rows", "dep_set_id"))
   {
     goto cleanup;
   }
-  _insert_message_handle = prepare_message_insert (_db);
-  if (_insert_message_handle == NULL)
+
+  _update_catalog_checksum_handle = prepare_catalog_checksum_update(_db);
+  if ( _update_catalog_checksum_handle == NULL )
   {
     goto cleanup;
   }
 
-  _insert_script_handle = prepare_script_insert (_db);
-  if (_insert_script_handle == NULL)
+  _insert_fingerprint_handle = prepare_fingerprint_insert (_db);
+  if (_insert_fingerprint_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_patch_handle = prepare_patch_insert (_db);
-  if (_insert_patch_handle == NULL)
+  _delete_res_handle = prepare_res_delete (_db);
+  if (_delete_res_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_pattern_handle = prepare_pattern_insert (_db);
-  if (_insert_pattern_handle == NULL)
+  _select_dep_name_handle = prepare_dep_name_select (_db);
+  if (_select_dep_name_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_product_handle = prepare_product_insert (_db);
-  if (_insert_product_handle == NULL)
+  _insert_dep_name_handle = prepare_dep_name_insert (_db);
+  if (_insert_dep_name_handle == NULL)
   {
     goto cleanup;
   }
 
-  _insert_dep_handle = prepare_dep_insert (_db);
-  if (_insert_dep_handle == NULL)
+  _select_dep_set_handle = prepare_dep_set_select (_db);
+  if (_select_dep_set_handle == NULL)
   {
     goto cleanup;
   }
 
-  _update_catalog_checksum_handle = prepare_catalog_checksum_update(_db);
-  if ( _update_catalog_checksum_handle == NULL )
+  _insert_dep_set_handle = prepare_dep_set_insert (_db);
+  if (_insert_dep_set_handle == NULL)
+  {
+    goto cleanup;
+  }
+
+  _insert_res_dep_set_handle = prepare_res_dep_set_insert (_db);
+  if (_insert_res_dep_set_handle == NULL)
+  {
+    goto cleanup;
+  }
+
+  _insert_dep_blob_handle = prepare_dep_blob_insert (_db);
+  if (_insert_dep_blob_handle == NULL)
+  {
+    goto cleanup;
+  }
+
+  _insert_file_provide_handle = prepare_file_dependency_insert (_db, "file_provides");
+  if (_insert_file_provide_handle == NULL)
+  {
+    goto cleanup;
+  }
+
+  _insert_file_require_handle = prepare_file_dependency_insert (_db, "file_requires");
+  if (_insert_file_require_handle == NULL)
   {
     goto cleanup;
   }
@@ -569,7 +1072,7 @@ DbAccess::prepareWrite(void)
 cleanup:
   if (result == false)
   {
-    closeDb();
+    releaseHandles();
   }
 
   return result;
@@ -597,6 +1100,7 @@ DbAccess::openDb( bool for_writing )
     cerr << "1|Can't open " << _dbfile << endl;
     return false;
   }
+  sqlite3_busy_timeout( _db, 30000 );	// zmd or another helper may be writing
 
   if (for_writing)
   {
@@ -630,22 +1134,23 @@ DbAccess::closeDb(void)
 {
   XXX << "DbAccess::closeDb()" << endl;
 
+  if (_staging)
+    abortStaging();
+  if (_bulk_load)
+    endBulkLoad();
+
+  _dep_writer.flush();		// write pending dependencies
+  _dep_set_writer.flush();
+  if (_insert_res_dep_set_handle)	// opened for writing
+    purgeDependencySets();
   commit();
 
-  close_handle( &_insert_res_handle );
-  close_handle( &_insert_pkg_handle );
-  close_handle( &_insert_patch_package_handle );
-  close_handle( &_insert_patch_package_baseversion_handle );
-  close_handle( &_insert_delta_package_handle );
-  close_handle( &_insert_message_handle );
-  close_handle( &_insert_script_handle );
-  close_handle( &_insert_patch_handle );
-  close_handle( &_insert_pattern_handle );
-  close_handle( &_insert_product_handle );
-  close_handle( &_insert_dep_handle );
+  releaseHandles();
+  _dep_name_ids.clear();
 
   if (_db)
   {
+    DbStatementCache::release( _db );
     sqlite3_close (_db);
     _db = NULL;
   }
@@ -654,10 +1159,57 @@ DbAccess::closeDb(void)
 
 
 void
+DbAccess::releaseHandles(void)
+{
+  _dep_writer.close();
+  _dep_set_writer.close();
+
+  close_handle( &_insert_res_handle );
+  for (int details = 0; details < DbResRecord::DETAILS_COUNT; ++details)
+    close_handle( &_insert_details_handles[details] );
+  close_handle( &_insert_patch_package_handle );
+  close_handle( &_insert_patch_package_baseversion_handle );
+  close_handle( &_insert_delta_package_handle );
+  close_handle( &_update_catalog_checksum_handle );
+  close_handle( &_insert_fingerprint_handle );
+  close_handle( &_delete_res_handle );
+  close_handle( &_select_dep_name_handle );
+  close_handle( &_insert_dep_name_handle );
+  close_handle( &_select_dep_set_handle );
+  close_handle( &_insert_dep_set_handle );
+  close_handle( &_insert_res_dep_set_handle );
+  close_handle( &_insert_dep_blob_handle );
+  close_handle( &_insert_file_provide_handle );
+  close_handle( &_insert_file_require_handle );
+  _dep_set_ids.clear();
+}
+
+
+bool
 DbAccess::commit(void)
 {
-  if (_db)
-    sqlite3_exec (_db, "COMMIT", NULL, NULL, NULL);
+  if (_db == NULL)
+    return true;
+  if (sqlite3_exec (_db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+  {
+    ERR << "COMMIT failed: " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+  return true;
+}
+
+
+bool
+DbAccess::begin(void)
+{
+  if (_db == NULL)
+    return false;
+  if (sqlite3_exec (_db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+  {
+    ERR << "BEGIN failed: " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+  return true;
 }
 
 
@@ -684,36 +1236,27 @@ DbAccess::updateCatalogChecksum( const std::string &catalog, const std::string &
 //----------------------------------------------------------------------------
 // dependency
 
-void
-DbAccess::writeDependency( sqlite_int64 res_id, RCDependencyType type, const zypp::CapSet & capabilities)
+static void
+append_dependency_rows( RCDependencyType type, const zypp::CapSet & capabilities, std::vector<DbDependencyRow> & rows )
 {
-  XXX << "DbAccess::writeDependency(" << res_id << ", " << type << ", ...)" << endl;
-
-  int rc;
-  sqlite3_stmt *handle = _insert_dep_handle;
-
   if (capabilities.empty())
     return;
 
+  DbDependencyRow row;
+  row.dep_type = type;						// type (provides, requires, ...)
+
   for (zypp::CapSet::const_iterator iter = capabilities.begin(); iter != capabilities.end(); ++iter)
   {
-    XXX << "Cap " << *iter << endl;
     RCDependencyTarget refers = kind2target( iter->refers() );
     if (refers == RC_DEP_TARGET_UNKNOWN) continue;
 
-    sqlite3_bind_int64( handle, 1, res_id);						// who issues the dependency
-    sqlite3_bind_int( handle, 2, type);						// type (provides, requires, ...)
-    sqlite3_bind_text( handle, 3, iter->index().c_str(), -1, SQLITE_STATIC );	// tag
+    row.name = iter->index();					// tag, interned by the writer
 
     Edition edition;
-    string version;
-    string release;
     Rel op;
     if ( capability::VersionedCap::constPtr vercap = capability::asKind<capability::VersionedCap>(*iter) )
     {
       edition = vercap->edition();
-      version = edition.version();
-      release = edition.release();
     }
     else
     {
@@ -725,356 +1268,347 @@ DbAccess::writeDependency( sqlite_int64 res_id, RCDependencyType type, const zyp
         && op != Rel::ANY
         && edition != Edition::noedition)
     {
-      sqlite3_bind_text( handle, 4, version.c_str(), -1, SQLITE_STATIC );	// version
-      sqlite3_bind_text( handle, 5, release.c_str(), -1, SQLITE_STATIC );	// release
+      row.versioned = true;
+      row.version = edition.version();
+      row.release = edition.release();
       Edition::epoch_t epoch = edition.epoch();
-      if ( epoch != Edition::noepoch )
-      {
-        sqlite3_bind_int( handle, 6, epoch);						// epoch
-      }
-      else
-      {
-        sqlite3_bind_int( handle, 6, 0);
-      }
-      sqlite3_bind_int( handle, 7, -1);							// arch
-      sqlite3_bind_int( handle, 8, Rel2Rc( op ));					// operation (==, <, <=, ...)
+      row.epoch = (epoch != Edition::noepoch) ? epoch : 0;
+      row.relation = DbAccess::Rel2Rc( op );				// operation (==, <, <=, ...)
     }
     else
     {
       // no operation or edition given
-      sqlite3_bind_text( handle, 4, NULL, -1, SQLITE_STATIC );
-      sqlite3_bind_text( handle, 5, NULL, -1, SQLITE_STATIC );
-      sqlite3_bind_int( handle, 6, 0);
-      sqlite3_bind_int( handle, 7, -1);				// arch
-      sqlite3_bind_int( handle, 8, RC_RELATION_NONE );
+      row.versioned = false;
+      row.version.clear();
+      row.release.clear();
+      row.epoch = 0;
+      row.relation = RC_RELATION_NONE;
     }
+    row.arch = -1;
+    row.dep_target = refers;					// resolvable kind the dependency refers to
 
-    sqlite3_bind_int( handle, 9, refers );					// resolvable kind the dependency refers to
-
-    rc = sqlite3_step( handle);
-    sqlite3_reset( handle);
-
-    if (rc != SQLITE_DONE)
-    {
-      ERR << "Error adding package to SQL: " << sqlite3_errmsg (_db) << endl;
-    }
+    rows.push_back( row );
   }
   return;
 }
 
 
-void
-DbAccess::writeDependencies(sqlite_int64 id, Resolvable::constPtr res)
+// RCDependencyType <-> zypp::Dep, in the order dependencies are written
+
+static const struct deptype
 {
-  XXX << "DbAccess::writeDependencies(" << id << ", " << *res << ")" << endl;
+  RCDependencyType type;
+  const Dep *dep;
+}
+deptable[] = {
+                { RC_DEP_TYPE_REQUIRE,		&Dep::REQUIRES },
+                { RC_DEP_TYPE_PROVIDE,		&Dep::PROVIDES },
+                { RC_DEP_TYPE_CONFLICT,		&Dep::CONFLICTS },
+                { RC_DEP_TYPE_OBSOLETE,		&Dep::OBSOLETES },
+                { RC_DEP_TYPE_PREREQUIRE,	&Dep::PREREQUIRES },
+                { RC_DEP_TYPE_FRESHEN,		&Dep::FRESHENS },
+                { RC_DEP_TYPE_RECOMMEND,	&Dep::RECOMMENDS },
+                { RC_DEP_TYPE_SUGGEST,		&Dep::SUGGESTS },
+                { RC_DEP_TYPE_SUPPLEMENT,	&Dep::SUPPLEMENTS },
+                { RC_DEP_TYPE_ENHANCE,		&Dep::ENHANCES },
+              };
+
+#define DEPTABLE_SIZE (sizeof(deptable) / sizeof(deptable[0]))
+
 
-  writeDependency( id, RC_DEP_TYPE_REQUIRE,	 res->dep (Dep::REQUIRES));
-  writeDependency( id, RC_DEP_TYPE_PROVIDE,	 res->dep (Dep::PROVIDES));
-  writeDependency( id, RC_DEP_TYPE_CONFLICT,	 res->dep (Dep::CONFLICTS));
-  writeDependency( id, RC_DEP_TYPE_OBSOLETE,	 res->dep (Dep::OBSOLETES));
-  writeDependency( id, RC_DEP_TYPE_PREREQUIRE, res->dep (Dep::PREREQUIRES));
-  writeDependency( id, RC_DEP_TYPE_FRESHEN,	 res->dep (Dep::FRESHENS));
-  writeDependency( id, RC_DEP_TYPE_RECOMMEND,  res->dep (Dep::RECOMMENDS));
-  writeDependency( id, RC_DEP_TYPE_SUGGEST,	 res->dep (Dep::SUGGESTS));
-  writeDependency( id, RC_DEP_TYPE_SUPPLEMENT, res->dep (Dep::SUPPLEMENTS));
-  writeDependency( id, RC_DEP_TYPE_ENHANCE,	 res->dep (Dep::ENHANCES));
+// content hash of all dependencies of res, equal for equal dependency sets
+
+static sqlite_int64
+depset_fingerprint( Resolvable::constPtr res )
+{
+  ostringstream os;
+  for (unsigned i = 0; i < DEPTABLE_SIZE; ++i)
+  {
+    const CapSet & caps( res->dep( *deptable[i].dep ) );
+    os << deptable[i].type << '{';
+    for (CapSet::const_iterator it = caps.begin(); it != caps.end(); ++it)
+    {
+      os << kind2target( it->refers() ) << ':' << it->asString() << '\n';
+    }
+    os << '}';
+  }
+  return fnv1a( os.str() );
 }
 
 
-//----------------------------------------------------------------------------
-// package
+// all dependencies of res, owner 0 and names inline
 
-sqlite_int64
-DbAccess::writePackage( sqlite_int64 id, Package::constPtr pkg, Ownership owner )
+static void
+dependency_rows( Resolvable::constPtr res, std::vector<DbDependencyRow> & rows )
 {
-  XXX <<  "DbAccess::writePackage(" << id << ", " << *pkg << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_pkg_handle;
+  rows.clear();
+  for (unsigned i = 0; i < DEPTABLE_SIZE; ++i)
+  {
+    append_dependency_rows( deptable[i].type, res->dep( *deptable[i].dep ), rows );
+  }
+}
+
 
-  sqlite3_bind_int64( handle, 1, id);
-  sqlite3_bind_text( handle, 2, pkg->group().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 3, pkg->summary().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 4, desc2str(pkg->description()).c_str(), -1, SQLITE_STATIC );
+// rows as written for owner_id to _dep_rows, names interned if intern is set
 
-  const char *package_url = pkg->location().asString().c_str();
-  if (package_url[0] == '.' && package_url[1] == '/') package_url += 2;		// strip leading "./"
+void
+DbAccess::ownDependencyRows( const std::vector<DbDependencyRow> & rows, sqlite_int64 owner_id, bool intern )
+{
+  _dep_rows = rows;
+  for (vector<DbDependencyRow>::iterator it = _dep_rows.begin(); it != _dep_rows.end(); ++it)
+  {
+    it->resolvable_id = owner_id;
+    it->name_id = (intern && !_staging) ? depNameId( it->name ) : 0;	// dep_names is not staged, see commitStaging()
+    if (it->name_id > 0)
+      it->name.clear();
+  }
+}
 
-  const char *url = package_url;
-  const char *filename = NULL;
 
-  switch ( owner )
+void
+DbAccess::writeDependencySet( DbDependencyWriter & writer, sqlite_int64 owner_id, const std::vector<DbDependencyRow> & rows )
+{
+  ownDependencyRows( rows, owner_id, _intern_dep_names );
+  for (vector<DbDependencyRow>::const_iterator it = _dep_rows.begin(); it != _dep_rows.end(); ++it)
   {
-  case ZYPP_OWNED:
-    filename = "";
-    break;
-  case ZMD_OWNED:
-    break;
-  case LOCAL_FILE:
-    url = NULL;
-    filename = package_url;
-    break;
-  default:
-    ERR << "Unknown ownership" << endl;
-    break;
+    writer.add( *it );
   }
+}
 
-  sqlite3_bind_text( handle, 5, url, -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 6, filename, -1, SQLITE_STATIC );
 
-  sqlite3_bind_text( handle, 7, NULL, -1, SQLITE_STATIC );			// signature_filename
-  sqlite3_bind_int( handle, 8, pkg->size() );
-  sqlite3_bind_int( handle, 9, pkg->installOnly() ? 1 : 0 );
-  sqlite3_bind_int( handle, 10, pkg->sourceMediaNr() );
+// all dependencies of resolvable id as one blob, see DbDependencyBlob.h
+
+bool
+DbAccess::writeDependencyBlob( sqlite_int64 id, const std::vector<DbDependencyRow> & rows )
+{
+  ownDependencyRows( rows, id, true );	// names are interned in blobs (but inline while staging)
+  _dep_blob.clear();
+  dep_blob_encode( _dep_rows, _dep_blob );
+
+  sqlite3_stmt *handle = _insert_dep_blob_handle;
+  sqlite3_bind_int64( handle, 1, id );
+  sqlite3_bind_blob( handle, 2, _dep_blob.data(), _dep_blob.size(), SQLITE_STATIC );
+
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
 
-  rc = sqlite3_step( handle);
-  
   if (rc != SQLITE_DONE)
   {
-    ERR << "Error adding package to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
+    ERR << "Error adding dependency blob to SQL: " << sqlite3_errmsg (_db) << endl;
+    return false;
   }
-  sqlite_int64 package_rowid = sqlite3_last_insert_rowid (_db);
-  sqlite3_reset( handle);
+  return true;
+}
 
 
-  // access package implementation to get delta and patch rpm info
-  detail::ResImplTraits<Package::Impl>::constPtr pipp( detail::ImplConnect::resimpl( pkg ) );
+// file requires of resolvable id to file_requires and, if split is set,
+//  its file provides to file_provides
+//  returns rows without the split off file provides, they are only read
+//  back if some resolvable requires their path (see DbSourceImpl::readFileProvides())
+//  The requires are recorded even when not splitting, a packed dependency
+//  blob can't be searched for them.
 
-  // save delta rpms
-  std::list<DeltaRpm> deltas = pipp->deltaRpms();
-  if ( ! deltas.empty() )
+const std::vector<DbDependencyRow> &
+DbAccess::splitFileDependencies( sqlite_int64 id, const std::vector<DbDependencyRow> & rows, bool split )
+{
+  _dep_split.clear();
+  for (vector<DbDependencyRow>::const_iterator it = rows.begin(); it != rows.end(); ++it)
   {
-    //DBG << "Package " << pkg->name() << " " << pkg->edition() << " contains " << deltas.size() << " delta rpms" << std::endl;
-    for ( std::list<DeltaRpm>::const_iterator it = deltas.begin(); it != deltas.end(); ++it )
+    sqlite3_stmt *handle = NULL;
+    if (it->name.empty()
+        || it->name[0] != '/')
     {
-      writeDeltaPackage ( package_rowid, *it );
+      _dep_split.push_back( *it );
+      continue;
     }
-  }
-  
-  // save patch rpms
-  std::list<PatchRpm> patches = pipp->patchRpms();
-  if ( ! patches.empty() )
-  {
-    //DBG << "Package " << pkg->name() << " " << pkg->edition() << " contains " << patches.size() << " patch rpms" << std::endl;
-    for ( std::list<PatchRpm>::const_iterator it = patches.begin(); it != patches.end(); ++it )
+    if (split
+        && it->dep_type == RC_DEP_TYPE_PROVIDE
+        && !it->versioned)
+    {
+      handle = _insert_file_provide_handle;
+    }
+    else
+    {
+      _dep_split.push_back( *it );
+      if (it->dep_type == RC_DEP_TYPE_REQUIRE
+          || it->dep_type == RC_DEP_TYPE_PREREQUIRE)
+      {
+        handle = _insert_file_require_handle;
+      }
+    }
+    if (handle == NULL)
+      continue;
+
+    sqlite3_bind_int64( handle, 1, id );
+    sqlite3_bind_text( handle, 2, it->name.c_str(), -1, SQLITE_STATIC );
+    sqlite3_bind_int( handle, 3, it->dep_target );
+    int rc = sqlite3_step( handle );
+    sqlite3_reset( handle );
+    if (rc != SQLITE_DONE)
     {
-      writePatchPackage ( package_rowid, *it );
+      ERR << "Error adding file dependency " << it->name << ": " << sqlite3_errmsg (_db) << endl;
+      if (handle == _insert_file_provide_handle)
+        _dep_split.push_back( *it );		// keep it with the others then
     }
   }
-  return package_rowid;
+  return _dep_split;
 }
 
-// patch rpm
-//----------------------------------------------------------------------------
-sqlite_int64
-DbAccess::writePatchPackage (sqlite_int64 package_id, const PatchRpm &patch_pkg )
-{
-  /*  " ( package_id, media_nr, location, checksum, download_size, build_time ) "
-        " VALUES (?, ?, ?, ?, ?, ?)");*/
-  //XXX << package_id << ", " << patch_pkg << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_patch_package_handle;
 
-  sqlite3_bind_int64( handle, 1, package_id);
+void
+DbAccess::writeDependencies( sqlite_int64 id, const DbResRecord & record )
+{
+  const vector<DbDependencyRow> & rows = splitFileDependencies( id, record.dependencies, _split_file_provides );
+  if (_share_dep_sets)
+  {
+    // split sets lack the file provides, keep them apart from complete ones
+    sqlite_int64 hash = _split_file_provides ? ~record.dep_set_hash : record.dep_set_hash;
+    sqlite_int64 set_id = depSetId( hash, rows );
+    if (set_id > 0
+        && writeResDepSet( id, set_id ))
+    {
+      return;
+    }
+    WAR << "Can't share dependencies of " << record.name << ", writing them inline" << endl;
+  }
+  else if (_pack_deps)
+  {
+    if (writeDependencyBlob( id, rows ))
+      return;
+    WAR << "Can't pack dependencies of " << record.name << ", writing them inline" << endl;
+  }
 
-  // on media location data
-  sqlite3_bind_int( handle, 2, patch_pkg.location().medianr() );
-  sqlite3_bind_text( handle, 3, patch_pkg.location().filename().asString().c_str(), -1, SQLITE_STATIC );
-  std::string checksum_encoded_string = patch_pkg.location().checksum().type() + ":" + patch_pkg.location().checksum().checksum();
-  sqlite3_bind_text( handle, 4, checksum_encoded_string.c_str() , -1, SQLITE_STATIC );
-  sqlite3_bind_int( handle, 5, patch_pkg.location().downloadsize() );
+  writeDependencySet( _dep_writer, id, rows );
+}
 
-  // buildtime data
-  sqlite3_bind_int( handle, 6, patch_pkg.buildtime() );
 
-  rc = sqlite3_step( handle);
+// id of the dependency set hash, rows written if needed
+//  returns 0 on error
 
-  if (rc != SQLITE_DONE)
-  {
-    ERR << "Error adding patch package to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
-  }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
+sqlite_int64
+DbAccess::depSetId( sqlite_int64 hash, const std::vector<DbDependencyRow> & rows )
+{
+  DepSetIdMap::const_iterator it = _dep_set_ids.find( hash );
+  if (it != _dep_set_ids.end())
+    return it->second;
+
+  sqlite_int64 id = 0;
+  sqlite3_stmt *handle = _select_dep_set_handle;
+  sqlite3_bind_int64( handle, 1, hash );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+    id = sqlite3_column_int64( handle, 0 );
+  sqlite3_reset( handle );
 
-  // base version data
-  for ( PatchRpm::BaseVersions::const_iterator it = patch_pkg.baseversions().begin(); it != patch_pkg.baseversions().end(); ++it)
+  if (id == 0)
   {
-    writePatchPackageBaseversion( rowid, *it );
+    handle = _insert_dep_set_handle;
+    sqlite3_bind_int64( handle, 1, hash );
+    int rc = sqlite3_step( handle );
+    sqlite3_reset( handle );
+    if (rc != SQLITE_DONE)
+    {
+      ERR << "Error adding dependency set: " << sqlite3_errmsg (_db) << endl;
+      return 0;
+    }
+    id = sqlite3_last_insert_rowid( _db );
+    writeDependencySet( _dep_set_writer, id, rows );
   }
 
-  sqlite3_reset( handle);
-  return rowid;
+  _dep_set_ids[hash] = id;
+  return id;
 }
 
-sqlite_int64
-DbAccess::writePatchPackageBaseversion(sqlite_int64 patch_package_id, const PatchRpm::BaseVersion &baseversion )
+
+bool
+DbAccess::writeResDepSet( sqlite_int64 id, sqlite_int64 set_id )
 {
-  //MIL << "writing " << baseversion << std::endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_patch_package_baseversion_handle;
+  sqlite3_stmt *handle = _insert_res_dep_set_handle;
 
-  sqlite3_bind_int64( handle, 1, patch_package_id);
+  sqlite3_bind_int64( handle, 1, id );
+  sqlite3_bind_int64( handle, 2, set_id );
 
-  sqlite3_bind_text( handle, 2, baseversion.version().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 3, baseversion.release().c_str(), -1, SQLITE_STATIC );
-  if ( baseversion.epoch() == Edition::noepoch)
-  {
-    sqlite3_bind_int( handle, 4, 0);
-  }
-  else
-  {
-    sqlite3_bind_int( handle, 4,  baseversion.epoch() );
-  }
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
 
-  rc = sqlite3_step( handle);
-  
   if (rc != SQLITE_DONE)
   {
-    ERR << "Error adding patch package baseversion to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
+    ERR << "Error adding resolvable dependency set to SQL: " << sqlite3_errmsg (_db) << endl;
+    return false;
   }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
-  
-  sqlite3_reset( handle);
-
-  return rowid;
+  return true;
 }
 
 
-// delta rpm
-//----------------------------------------------------------------------------
-sqlite_int64
-DbAccess::writeDeltaPackage (sqlite_int64 package_id, const DeltaRpm &delta_pkg )
-{
-  //XXX << package_id << ", " << delta_pkg << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_delta_package_handle;
-
-  //  "INSERT INTO delta_packages "
-    //    1           2         3         4         5              6
-  //  " ( package_id, media_nr, location, checksum, download_size, build_time"
-    //    7                     8                     9                     10                  11                    12
-  //  "  , baseversion_version, baseversion_release, baseversion_epoch, baseversion_checksum, baseversion_build_time, baseversion_sequence_info ) "
-  //  " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
-  
-  //MIL << "Delta: " << std::endl;
-  //MIL << package_id << " " << delta_pkg.location().medianr() << " " << delta_pkg.location().filename().asString() << std::endl;
-  
-  try {
-    rc = sqlite3_bind_int64( handle, 1, package_id);
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    // on media location data
-    rc = sqlite3_bind_int( handle, 2, delta_pkg.location().medianr() );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    rc = sqlite3_bind_text( handle, 3, delta_pkg.location().filename().asString().c_str(), -1, SQLITE_STATIC );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    std::string checksum_encoded_string = delta_pkg.location().checksum().type() + ":" + delta_pkg.location().checksum().checksum();
-    
-    // this segfaults
-    rc = sqlite3_bind_text( handle, 4, checksum_encoded_string.c_str() , -1, SQLITE_STATIC );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    rc = sqlite3_bind_int( handle, 5, (int)  delta_pkg.location().downloadsize() );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    // delta rpm own data
-    rc = sqlite3_bind_int( handle, 6, (int) delta_pkg.buildtime() );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-  
-    // base version data
-    rc = sqlite3_bind_text( handle, 7, delta_pkg.baseversion().edition().version().c_str(), -1, SQLITE_STATIC );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    rc = sqlite3_bind_text( handle, 8, delta_pkg.baseversion().edition().release().c_str(), -1, SQLITE_STATIC );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    if (delta_pkg.baseversion().edition().epoch() == Edition::noepoch)
-    {
-      rc = sqlite3_bind_int( handle, 9, 0);
-      if ( rc != SQLITE_OK )
-        ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    }
-    else
-    {
-      rc = sqlite3_bind_int( handle, 9, (int)  delta_pkg.baseversion().edition().epoch() );
-      if ( rc != SQLITE_OK )
-        ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    }
-    checksum_encoded_string = delta_pkg.baseversion().checksum().type() + ":" + delta_pkg.baseversion().checksum().checksum();
-    rc = sqlite3_bind_text( handle, 10, checksum_encoded_string.c_str() , -1, SQLITE_STATIC );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    rc = sqlite3_bind_int( handle, 11, (int)  delta_pkg.baseversion().buildtime() );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
-    
-    rc = sqlite3_bind_text( handle, 12, delta_pkg.baseversion().sequenceinfo().c_str() , -1, SQLITE_STATIC );
-    if ( rc != SQLITE_OK )
-      ZYPP_THROW(Exception(sqlite3_errmsg(_db)));
+// drop dependency sets no resolvable refers to anymore
 
-  }
-  catch ( const Exception &e )
+void
+DbAccess::purgeDependencySets( void )
+{
+  char *errmsg = NULL;
+  if (sqlite3_exec (_db, "DELETE FROM dependency_sets WHERE id NOT IN (SELECT dep_set_id FROM resolvable_dep_sets)", NULL, NULL, &errmsg) != SQLITE_OK)
   {
-    ERR << "Error adding delta package to SQL: " << e.msg() << endl;
-    return -1;
+    ERR << "Can not purge dependency sets: " << (errmsg ? errmsg : "") << endl;
+    sqlite3_free (errmsg);
+    return;
   }
-   
-  
-  //FIXME add build time data
+  int purged = sqlite3_changes (_db);
+  if (purged > 0)
+    MIL << "Purged " << purged << " unused dependency sets" << endl;
+}
 
 
-  rc = sqlite3_step( handle);
+//----------------------------------------------------------------------------
+// package rpms
 
-  if (rc != SQLITE_DONE)
+// delta and patch rpms of package_details row package_id
+
+void
+DbAccess::writePackageRpms( sqlite_int64 package_id, const DbResRecord & record )
+{
+  for (vector<DbDeltaRecord>::const_iterator it = record.deltas.begin(); it != record.deltas.end(); ++it)
   {
-    ERR << "Error adding delta package to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
+    writeDeltaPackage( package_id, *it );
   }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
-  sqlite3_reset( handle);
-  return rowid;
-}
 
+  for (vector<DbPatchRpmRecord>::const_iterator it = record.patch_rpms.begin(); it != record.patch_rpms.end(); ++it)
+  {
+    writePatchPackage( package_id, *it );
+  }
+}
 
+// patch rpm
 //----------------------------------------------------------------------------
-// message
-
 sqlite_int64
-DbAccess::writeMessage (sqlite_int64 id, Message::constPtr message )
+DbAccess::writePatchPackage (sqlite_int64 package_id, const DbPatchRpmRecord &patch_pkg )
 {
-  XXX <<  "DbAccess::writeMessage(" << id << ", " << *message << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_message_handle;
-
-  sqlite3_bind_int64( handle, 1, id);
-  sqlite3_bind_text( handle, 2, message->text().asString().c_str(), -1, SQLITE_STATIC );
-
-  rc = sqlite3_step( handle);
-  sqlite3_reset( handle);
+  sqlite_int64 rowid = insert_row( _db, _insert_patch_package_handle, patch_rpm_schema, package_id, patch_pkg );
+  if (rowid < 0)
+    return -1;
 
-  if (rc != SQLITE_DONE)
+  // base version data
+  for (vector<DbBaseVersionRecord>::const_iterator it = patch_pkg.baseversions.begin(); it != patch_pkg.baseversions.end(); ++it)
   {
-    ERR << "Error adding message to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
+    writePatchPackageBaseversion( rowid, *it );
   }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
 
   return rowid;
 }
 
+sqlite_int64
+DbAccess::writePatchPackageBaseversion(sqlite_int64 patch_package_id, const DbBaseVersionRecord &baseversion )
+{
+  return insert_row( _db, _insert_patch_package_baseversion_handle, baseversion_schema, patch_package_id, baseversion );
+}
+
+
+// delta rpm
+//----------------------------------------------------------------------------
+sqlite_int64
+DbAccess::writeDeltaPackage (sqlite_int64 package_id, const DbDeltaRecord &delta_pkg )
+{
+  return insert_row( _db, _insert_delta_package_handle, delta_schema, package_id, delta_pkg );
+}
+
 
 //----------------------------------------------------------------------------
 // script
@@ -1100,248 +1634,585 @@ readFromPath( const Pathname & p )
   return result;
 }
 
-sqlite_int64
-DbAccess::writeScript (sqlite_int64 id, Script::constPtr script)
-{
-  XXX <<  "DbAccess::writeScript(" << id << ", " << *script << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_script_handle;
-
-  sqlite3_bind_int64( handle, 1, id);
-  string do_script( readFromPath( script->do_script() ) );
-  string undo_script( readFromPath( script->undo_script() ) );
-  sqlite3_bind_text( handle, 2, do_script.c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 3, undo_script.c_str(), -1, SQLITE_STATIC );
-
-  rc = sqlite3_step( handle);
-  sqlite3_reset( handle);
 
-  if (rc != SQLITE_DONE)
-  {
-    ERR << "Error adding message to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
-  }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
+// paths and content of the scripts of script
+//  do_script() may have to provide the file from media, so this runs on
+//  the thread owning the zypp objects, never on the record producer.
 
-  return rowid;
+static void
+read_script( Script::constPtr script, ScriptText & text )
+{
+  Pathname do_script( script->do_script() );
+  Pathname undo_script( script->undo_script() );
+  text.do_path = do_script.asString();
+  text.undo_path = undo_script.asString();
+  text.do_text = readFromPath( do_script );
+  text.undo_text = readFromPath( undo_script );
 }
 
 
 //----------------------------------------------------------------------------
-// patch
+// details
+
+// write the _details row of record (if its kind has one) for resolvables row id
+//  return rowid (> 0) on success
+//  return 0 if there are no details
+//  return < 0 on failure
 
 sqlite_int64
-DbAccess::writePatch (sqlite_int64 id, Patch::constPtr patch )
+DbAccess::writeDetails( sqlite_int64 id, const DbResRecord & record )
 {
-  XXX <<  "DbAccess::writePatch(" << id << ", " << *patch << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_patch_handle;
-
-  sqlite3_bind_int64( handle, 1, id );
-  sqlite3_bind_text( handle, 2, patch->id().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_int64( handle, 3, patch->timestamp() );
-  sqlite3_bind_int( handle, 4, patch->reboot_needed() ? 1 : 0 );
-  sqlite3_bind_int( handle, 5, patch->affects_pkg_manager() ? 1 : 0 );
-  sqlite3_bind_text( handle, 6, patch->summary().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 7, desc2str(patch->description()).c_str(), -1, SQLITE_STATIC );
-
-  rc = sqlite3_step( handle);
-  sqlite3_reset( handle);
+  const DbRowSchema<DbResRecord> *schema = details_schemas[record.details];
+  if (schema == NULL)
+    return 0;
 
-  if (rc != SQLITE_DONE)
+  sqlite_int64 rowid = insert_row( _db, _insert_details_handles[record.details], *schema, id, record );
+  if (rowid > 0
+      && record.details == DbResRecord::PACKAGE)
   {
-    ERR << "Error adding patch to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
+    writePackageRpms( rowid, record );
   }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
-
   return rowid;
 }
 
 
 //----------------------------------------------------------------------------
-// pattern
-
-sqlite_int64
-DbAccess::writePattern (sqlite_int64 id, Pattern::constPtr pattern )
-{
-  XXX <<  "DbAccess::writePattern(" << id << ", " << *pattern << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_pattern_handle;
-
-  sqlite3_bind_int64( handle, 1, id);
-  sqlite3_bind_text( handle, 2, pattern->summary().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 3, desc2str(pattern->description()).c_str(), -1, SQLITE_STATIC );
-
-  rc = sqlite3_step( handle);
-  sqlite3_reset( handle);
+// resolvable
 
-  if (rc != SQLITE_DONE)
-  {
-    ERR << "Error adding pattern to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
-  }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
+// "type:checksum" as stored in the db
 
-  return rowid;
+static string
+checksum2str( const CheckSum & checksum )
+{
+  return checksum.type() + ":" + checksum.checksum();
 }
 
-
-//----------------------------------------------------------------------------
-// product
-
-sqlite_int64
-DbAccess::writeProduct (sqlite_int64 id, Product::constPtr product )
+static int
+epoch2int( Edition::epoch_t epoch )
 {
-  XXX <<  "DbAccess::writeProduct(" << id << ", " << *product << ")" << endl;
-  int rc;
-  sqlite3_stmt *handle = _insert_product_handle;
-
-  sqlite3_bind_int64( handle, 1, id);
-  sqlite3_bind_text( handle, 2, product->summary().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 3, desc2str(product->description()).c_str(), -1, SQLITE_STATIC );
-
-  rc = sqlite3_step( handle);
-  sqlite3_reset( handle);
-
-  if (rc != SQLITE_DONE)
-  {
-    ERR << "Error adding product to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
-  }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
-
-  return rowid;
+  return (epoch == Edition::noepoch) ? 0 : epoch;
 }
 
+// fill record from obj, everything writeRecord() needs
+//  This is all the zypp work of writing obj, it does not touch the db.
+//  It runs on the record producer thread, so it must not log nor access
+//  media: problems go to record.problems, a Script needs its script_text
+//  (see read_script()).
 
-//----------------------------------------------------------------------------
-// resolvable
-
-// write ResObject to resolvables table
-//  return rowid (> 0) on success
-//  return < 0 on failure
-//  return == 0 if this kind of resolvable is to be skipped
-
-sqlite_int64
-DbAccess::writeResObject( ResObject::constPtr obj, ResStatus status, const char *catalog, Ownership owner )
+static void
+res_record( ResObject::constPtr obj, ResStatus status, const char *catalog, Ownership owner, bool pack, const ScriptText *script_text, DbResRecord & record )
 {
-  XXX << "DbAccess::writeResObject (" << *obj << ", " << status << ")" << endl;
-
-  if (obj->kind() == ResTraits<SystemResObject>::kind)
-    return 0;
+  record = DbResRecord();
 
   Resolvable::constPtr res = obj;
-  Package::constPtr pkg = asKind<Package>(res);
-  Message::constPtr message = asKind<Message>(res);
-  Script::constPtr script = asKind<Script>(res);
-  Patch::constPtr patch = asKind<Patch>(res);
-  Pattern::constPtr pattern = asKind<Pattern>(res);
-  Product::constPtr product = asKind<Product>(res);
+
+  record.name = obj->name();
+  Edition ed = obj->edition();
+  record.version = ed.version();
+  record.release = ed.release();
+  record.epoch = epoch2int( ed.epoch() );
+  record.arch = DbAccess::Arch2Rc( obj->arch() );
+  record.size = obj->size();
+  record.catalog = (catalog != NULL) ? string( catalog ) : obj->source().alias();
+  record.installed = status.isInstalled();
+  record.local = source_is_local( obj->source() );
+  record.status = resstatus2rcstatus( status );
+  record.kind = kind2target( obj->kind() );
+  if (record.kind == RC_DEP_TARGET_UNKNOWN)
+    record.problems.push_back( "Unknown resolvable kind " + obj->kind().asString() );
 
   zypp::License license;
 
-  int rc;
-  sqlite3_stmt *handle = _insert_res_handle;
+  switch (record.kind)		// kind2target() above, the casts can be static
+  {
+    case RC_DEP_TARGET_PACKAGE:
+    {
+      Package::constPtr pkg = static_pointer_cast<const Package>( obj );
+      record.details = DbResRecord::PACKAGE;
+      license = pkg->licenseToConfirm();
+      record.group = pkg->group();
+      record.summary = pkg->summary();
+      record.description = desc2str( pkg->description() );
+
+      string package_url = pkg->location().asString();
+      if (package_url.compare( 0, 2, "./" ) == 0)
+        package_url.erase( 0, 2 );						// strip leading "./"
+
+      switch ( owner )
+      {
+      case ZYPP_OWNED:
+        record.have_url = true;
+        record.url = package_url;
+        record.have_filename = true;						// empty filename
+        break;
+      case ZMD_OWNED:
+        record.have_url = true;
+        record.url = package_url;
+        break;
+      case LOCAL_FILE:
+        record.have_filename = true;
+        record.filename = package_url;
+        break;
+      default:
+        record.problems.push_back( "Unknown ownership" );
+        record.have_url = true;
+        record.url = package_url;
+        break;
+      }
 
-  // write NVRAD and all the rest
+      record.package_size = pkg->size();
+      record.install_only = pkg->installOnly();
+      record.media_nr = pkg->sourceMediaNr();
 
-  sqlite3_bind_text( handle, 1, obj->name().c_str(), -1, SQLITE_STATIC );
-  Edition ed = obj->edition();
-  sqlite3_bind_text( handle, 2, ed.version().c_str(), -1, SQLITE_STATIC );
-  sqlite3_bind_text( handle, 3, ed.release().c_str(), -1, SQLITE_STATIC );
-  if (ed.epoch() == Edition::noepoch)
+      // access package implementation to get delta and patch rpm info
+      detail::ResImplTraits<Package::Impl>::constPtr pipp( detail::ImplConnect::resimpl( pkg ) );
+
+      std::list<DeltaRpm> deltas = pipp->deltaRpms();
+      for ( std::list<DeltaRpm>::const_iterator it = deltas.begin(); it != deltas.end(); ++it )
+      {
+        DbDeltaRecord delta;
+        delta.media_nr = it->location().medianr();
+        delta.location = it->location().filename().asString();
+        delta.checksum = checksum2str( it->location().checksum() );
+        delta.download_size = (int) it->location().downloadsize();
+        delta.build_time = (int) it->buildtime();
+        delta.base_version = it->baseversion().edition().version();
+        delta.base_release = it->baseversion().edition().release();
+        delta.base_epoch = epoch2int( it->baseversion().edition().epoch() );
+        delta.base_checksum = checksum2str( it->baseversion().checksum() );
+        delta.base_build_time = (int) it->baseversion().buildtime();
+        delta.base_sequence_info = it->baseversion().sequenceinfo();
+        record.deltas.push_back( delta );
+      }
+
+      std::list<PatchRpm> patches = pipp->patchRpms();
+      for ( std::list<PatchRpm>::const_iterator it = patches.begin(); it != patches.end(); ++it )
+      {
+        DbPatchRpmRecord patch_rpm;
+        patch_rpm.media_nr = it->location().medianr();
+        patch_rpm.location = it->location().filename().asString();
+        patch_rpm.checksum = checksum2str( it->location().checksum() );
+        patch_rpm.download_size = it->location().downloadsize();
+        patch_rpm.build_time = it->buildtime();
+        for ( PatchRpm::BaseVersions::const_iterator bv = it->baseversions().begin(); bv != it->baseversions().end(); ++bv )
+        {
+          DbBaseVersionRecord baseversion;
+          baseversion.version = bv->version();
+          baseversion.release = bv->release();
+          baseversion.epoch = epoch2int( bv->epoch() );
+          patch_rpm.baseversions.push_back( baseversion );
+        }
+        record.patch_rpms.push_back( patch_rpm );
+      }
+      break;
+    }
+    case RC_DEP_TARGET_MESSAGE:
+    {
+      Message::constPtr message = static_pointer_cast<const Message>( obj );
+      record.details = DbResRecord::MESSAGE;
+      record.text = message->text().asString();
+      break;
+    }
+    case RC_DEP_TARGET_SCRIPT:
+    {
+      Script::constPtr script = static_pointer_cast<const Script>( obj );
+      record.details = DbResRecord::SCRIPT;
+      if (script_text != NULL)
+      {
+        record.text = script_text->do_text;
+        record.undo_text = script_text->undo_text;
+      }
+      else
+      {
+        record.problems.push_back( "Script files not read" );
+      }
+      break;
+    }
+    case RC_DEP_TARGET_PATCH:
+    {
+      Patch::constPtr patch = static_pointer_cast<const Patch>( obj );
+      record.details = DbResRecord::PATCH;
+      record.have_category = true;
+      record.category = patch->category();
+      license = patch->licenseToConfirm();
+      record.patch_id = patch->id();
+      record.timestamp = patch->timestamp();
+      record.reboot_needed = patch->reboot_needed();
+      record.affects_pkg_manager = patch->affects_pkg_manager();
+      record.summary = patch->summary();
+      record.description = desc2str( patch->description() );
+      break;
+    }
+    case RC_DEP_TARGET_PATTERN:
+    {
+      Pattern::constPtr pattern = static_pointer_cast<const Pattern>( obj );
+      record.details = DbResRecord::PATTERN;
+      record.summary = pattern->summary();
+      record.description = desc2str( pattern->description() );
+      break;
+    }
+    case RC_DEP_TARGET_PRODUCT:
+    {
+      Product::constPtr product = static_pointer_cast<const Product>( obj );
+      record.details = DbResRecord::PRODUCT;
+      record.have_category = true;
+      record.category = product->category();
+      license = product->licenseToConfirm();
+      record.summary = product->summary();
+      record.description = desc2str( product->description() );
+      break;
+    }
+    default:
+      break;
+  }
+
+  if (!license.empty())
   {
-    sqlite3_bind_int( handle, 4, 0);
+    record.have_license = true;
+    record.license = license;
   }
-  else
+
+  if (pack)
   {
-    sqlite3_bind_int( handle, 4, ed.epoch());
+    string blob;
+    if (text_pack( record.summary, blob ))
+    {
+      record.summary.swap( blob );
+      record.summary_packed = true;
+    }
+    if (text_pack( record.description, blob ))
+    {
+      record.description.swap( blob );
+      record.description_packed = true;
+    }
   }
-  sqlite3_bind_int( handle, 5, Arch2Rc (obj->arch()) );
 
-  sqlite3_bind_int64( handle, 6, obj->size() );
-  if (catalog != NULL)
-    sqlite3_bind_text( handle, 7, catalog, -1, SQLITE_STATIC );
-  else
-    sqlite3_bind_text( handle, 7, obj->source().alias().c_str(), -1, SQLITE_STATIC );
+  dependency_rows( res, record.dependencies );
+  record.dep_set_hash = depset_fingerprint( res );
+  record.fingerprint = resobject_fingerprint( obj, status, owner, script_text );
+}
+
+
+// write record to resolvables, its _details table and dependencies
+//  return rowid (> 0) on success
+//  return < 0 on failure
+
+sqlite_int64
+DbAccess::writeRecord( const DbResRecord & record )
+{
+  for (vector<string>::const_iterator it = record.problems.begin(); it != record.problems.end(); ++it)
+    ERR << record.name << "-" << record.version << "-" << record.release << ": " << *it << endl;
+
+  // write NVRAD and all the rest
+
+  sqlite_int64 rowid = insert_row( _db, _insert_res_handle, resolvable_schema, 0, record );
+  if (rowid < 0)
+    return -1;
+
+  // now write the respective _details table
+
+  writeDetails( rowid, record );
+
+  writeDependencies( rowid, record );
+
+  writeFingerprint( rowid, layoutFingerprint( record.fingerprint ) );
+
+  return rowid;
+}
+
+
+// write ResObject to resolvables table
+//  return rowid (> 0) on success
+//  return < 0 on failure
+//  return == 0 if this kind of resolvable is to be skipped
+
+sqlite_int64
+DbAccess::writeResObject( ResObject::constPtr obj, ResStatus status, const char *catalog, Ownership owner )
+{
+  XXX << "DbAccess::writeResObject (" << *obj << ", " << status << ")" << endl;
+
+  if (obj->kind() == ResTraits<SystemResObject>::kind)
+    return 0;
+
+  ScriptText script_text;
+  if (Script::constPtr script = asKind<Script>( obj ))
+    read_script( script, script_text );
+
+  res_record( obj, status, catalog, owner, _pack_text, &script_text, _record );
+  return writeRecord( _record );
+}
 
-  sqlite3_bind_int( handle,  8, status.isInstalled() ? 1 : 0);
 
-  Source_Ref src( obj->source() );
-  if (source_is_local( src ))
+//----------------------------------------------------------------------------
+// pipelined writes
+//
+// writeObjects() turns the objects into DbResRecords on a thread of its
+// own while the calling thread, which owns the db, writes the records in
+// order. While the producer runs, only it touches the zypp objects (they
+// are not thread safe) and only the caller touches sqlite and logs. The
+// scripts, which may need media access, are read by the caller before.
+
+typedef map<size_t, ScriptText> ScriptTextMap;	// objects index -> its scripts
+
+struct RecordProducer
+{
+  const vector<ResObject::constPtr> *objects;
+  const ScriptTextMap *scripts;
+  ResStatus status;
+  const char *catalog;
+  Ownership owner;
+  bool pack;				// see DbAccess::setPackText()
+  DbRecordQueue *queue;
+  string error;				// exception caught, if any
+};
+
+#define PIPELINE_MIN_OBJECTS 32	// fewer are written without a thread
+
+static void *
+produce_records( void *arg )
+{
+  RecordProducer *producer = (RecordProducer *) arg;
+  try
   {
-    sqlite3_bind_int( handle, 9, 1 );					//local_package
+    for (size_t i = 0; i < producer->objects->size(); ++i)
+    {
+      ScriptTextMap::const_iterator script = producer->scripts->find( i );
+      DbResRecord *record = new DbResRecord;
+      res_record( (*producer->objects)[i], producer->status, producer->catalog, producer->owner, producer->pack,
+                  (script != producer->scripts->end()) ? &script->second : NULL, *record );
+      if (!producer->queue->push( record ))
+        break;				// writer gave up
+    }
   }
-  else
+  catch (const Exception & excpt_r)
   {
-    sqlite3_bind_int( handle, 9, 0 );
+    producer->error = excpt_r.msg();
   }
-  sqlite3_bind_int( handle, 10, resstatus2rcstatus( status ) );
-
-  if (pkg != NULL)
+  catch (const std::exception & excpt_r)
   {
-    license = pkg->licenseToConfirm();
-    if (license.empty())
+    producer->error = excpt_r.what();
+  }
+  producer->queue->finish();
+  return NULL;
+}
+
+
+// called after each written object, reports progress every PROGRESS_INTERVAL objects
+//  and, while staging, commits every _chunk_size objects. The live tables are
+//  only ever written in one transaction. The last chunk is left to the caller,
+//  closeDb() or commitStaging() commit it. false if no transaction could be
+//  started again after a chunk.
+
+#define PROGRESS_INTERVAL 1000
+
+bool
+DbAccess::chunkDone( unsigned done, unsigned total )
+{
+  if (_chunk_size > 0
+      && _staging
+      && done % _chunk_size == 0
+      && done != total)
+  {
+    _dep_writer.flush();
+    _dep_set_writer.flush();
+    if (!commit())
+    {
+      WAR << "Chunk not committed, continuing in one transaction" << endl;
+    }
+    else if (sqlite3_exec (_db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK)
     {
-      sqlite3_bind_text( handle, 12, NULL, -1, SQLITE_STATIC );
+      ERR << "BEGIN failed: " << sqlite3_errmsg (_db) << endl;
+      return false;
     }
     else
     {
-      sqlite3_bind_text( handle, 12, license.c_str(), -1, SQLITE_STATIC );
+      DBG << "Committed " << done << " of " << total << endl;
     }
   }
-  else if (patch != NULL)
+
+  if (_report_progress
+      && total > 0
+      && (done % PROGRESS_INTERVAL == 0
+          || done == total))
   {
-    sqlite3_bind_text( handle, 11, patch->category().c_str(), -1, SQLITE_STATIC );
-    license = patch->licenseToConfirm();
-    if (license.empty())
+    cout << "2|" << done << "|" << total << endl;
+  }
+  return true;
+}
+
+
+// write objects (no SystemResObject), return number written or -1 on error
+//  last_rowid is the rowid of the last one written
+
+int
+DbAccess::writeObjects( const std::vector<zypp::ResObject::constPtr> & objects, ResStatus status, const char *catalog, Ownership owner, sqlite_int64 & last_rowid )
+{
+  int count = 0;
+  last_rowid = 0;
+
+  DbRecordQueue queue;
+  RecordProducer producer;
+  producer.objects = &objects;
+  producer.status = status;
+  producer.catalog = catalog;
+  producer.owner = owner;
+  producer.pack = _pack_text;
+  producer.queue = &queue;
+
+  bool pipelined = (objects.size() >= PIPELINE_MIN_OBJECTS);
+  ScriptTextMap scripts;
+  if (pipelined)
+  {
+    for (size_t i = 0; i < objects.size(); ++i)
     {
-      sqlite3_bind_text( handle, 12, NULL, -1, SQLITE_STATIC );
+      if (Script::constPtr script = asKind<Script>( objects[i] ))
+        read_script( script, scripts[i] );
     }
-    else
+  }
+  producer.scripts = &scripts;
+
+  pthread_t thread;
+  if (pipelined
+      && pthread_create( &thread, NULL, produce_records, &producer ) != 0)
+  {
+    WAR << "Can't start record producer, writing serially" << endl;
+    pipelined = false;
+  }
+
+  if (!pipelined)
+  {
+    for (vector<ResObject::constPtr>::const_iterator it = objects.begin(); it != objects.end(); ++it)
     {
-      sqlite3_bind_text( handle, 12, license.c_str(), -1, SQLITE_STATIC );
+      last_rowid = writeResObject( *it, status, catalog, owner );
+      if (last_rowid < 0
+          || !chunkDone( ++count, objects.size() ))
+      {
+        return -1;
+      }
     }
+    return count;
   }
-  else if (product != NULL)
+
+  DbResRecord *record;
+  while ((record = queue.pop()) != NULL)
   {
-    sqlite3_bind_text( handle, 11, product->category().c_str(), -1, SQLITE_STATIC );
-    license = product->licenseToConfirm();
-    if (license.empty())
+    last_rowid = writeRecord( *record );
+    delete record;
+    if (last_rowid >= 0
+        && !chunkDone( ++count, objects.size() ))
     {
-      sqlite3_bind_text( handle, 12, NULL, -1, SQLITE_STATIC );
+      last_rowid = -1;
     }
-    else
+    if (last_rowid < 0)
     {
-      sqlite3_bind_text( handle, 12, license.c_str(), -1, SQLITE_STATIC );
+      queue.cancel();
+      break;
     }
   }
+  pthread_join( thread, NULL );
 
-  sqlite3_bind_int( handle, 13, kind2target( obj->kind() ) );
+  if (!producer.error.empty())
+    ZYPP_THROW( Exception( producer.error ) );
 
-  rc = sqlite3_step( handle );
+  DBG << "Pipelined " << count << " records" << endl;
+  return (last_rowid < 0) ? -1 : count;
+}
+
+
+// fingerprint as stored, the content fingerprint mixed with the write options
+//  shaping the rows: changing one of them rewrites every row on the next
+//  sync. With all options off it is the content fingerprint itself.
+
+sqlite_int64
+DbAccess::layoutFingerprint( sqlite_int64 content ) const
+{
+  unsigned long long options = (_intern_dep_names ? 1 : 0)
+                               | (_share_dep_sets ? 2 : 0)
+                               | (_pack_deps ? 4 : 0)
+                               | (_split_file_provides ? 8 : 0)
+                               | (_pack_text ? 16 : 0);
+  return content ^ (sqlite_int64)(options * 0x9e3779b97f4a7c15ULL);
+}
+
+
+// remember content fingerprint of resolvable, see syncStore()
+
+bool
+DbAccess::writeFingerprint( sqlite_int64 id, sqlite_int64 fingerprint )
+{
+  sqlite3_stmt *handle = _insert_fingerprint_handle;
+
+  sqlite3_bind_int64( handle, 1, id );
+  sqlite3_bind_int64( handle, 2, fingerprint );
+
+  int rc = sqlite3_step( handle );
   sqlite3_reset( handle );
 
   if (rc != SQLITE_DONE)
   {
-    ERR << "Error adding package to SQL: " << sqlite3_errmsg (_db) << endl;
-    return -1;
+    ERR << "Error adding fingerprint to SQL: " << sqlite3_errmsg (_db) << endl;
+    return false;
   }
-  sqlite_int64 rowid = sqlite3_last_insert_rowid (_db);
+  return true;
+}
 
-  // now write the respective _details table
 
-  if (pkg != NULL) writePackage( rowid, pkg, owner );
-  else if (message != NULL) writeMessage( rowid, message );
-  else if (script != NULL) writeScript( rowid, script );
-  else if (patch != NULL) writePatch( rowid, patch );
-  else if (pattern != NULL) writePattern( rowid, pattern );
-  else if (product != NULL) writeProduct( rowid, product );
+// id of dependency name in dep_names, inserting it if needed
+//  returns 0 on error, the caller then writes the name inline
 
-  writeDependencies (rowid, obj);
+sqlite_int64
+DbAccess::depNameId( const std::string & name )
+{
+  DepNameIdMap::const_iterator it = _dep_name_ids.find( name );
+  if (it != _dep_name_ids.end())
+    return it->second;
+
+  sqlite_int64 id = 0;
+  sqlite3_stmt *handle = _select_dep_name_handle;
+  sqlite3_bind_text( handle, 1, name.c_str(), -1, SQLITE_STATIC );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+    id = sqlite3_column_int64( handle, 0 );
+  sqlite3_reset( handle );
 
-  return rowid;
+  if (id == 0)
+  {
+    handle = _insert_dep_name_handle;
+    sqlite3_bind_text( handle, 1, name.c_str(), -1, SQLITE_STATIC );
+    int rc = sqlite3_step( handle );
+    sqlite3_reset( handle );
+    if (rc != SQLITE_DONE)
+    {
+      ERR << "Error adding dependency name '" << name << "': " << sqlite3_errmsg (_db) << endl;
+      return 0;
+    }
+    id = sqlite3_last_insert_rowid( _db );
+  }
+
+  _dep_name_ids[name] = id;
+  return id;
+}
+
+
+// remove a single resolvable (and, by trigger, its details and dependencies)
+
+bool
+DbAccess::deleteResObject( sqlite_int64 id )
+{
+  XXX << "DbAccess::deleteResObject(" << id << ")" << endl;
+
+  sqlite3_stmt *handle = _delete_res_handle;
+
+  sqlite3_bind_int64( handle, 1, id );
+
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
+
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error removing resolvable " << id << ": " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+  return true;
 }
 
 
@@ -1352,7 +2223,7 @@ DbAccess::haveCatalog( const std::string & catalog )
 {
   string query ("SELECT * FROM catalogs WHERE id = ? ");
 
-  sqlite3_stmt *handle = prepare_handle( _db, query );
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( query );
   if (handle == NULL)
   {
     return false;
@@ -1374,10 +2245,89 @@ DbAccess::haveCatalog( const std::string & catalog )
   return (rc == SQLITE_ROW);
 }
 
+// count resolvables of catalog per kind into entry
+
+static bool
+count_catalog( sqlite3 *db, const std::string &catalog, DBCatalogEntry &entry )
+{
+  sqlite3_stmt *handle = prepare_handle( db, "SELECT kind, COUNT(*) FROM resolvables WHERE catalog = ? GROUP BY kind" );
+  if (handle == NULL)
+    return false;
+
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  int rc;
+  while ((rc = sqlite3_step( handle )) == SQLITE_ROW)
+  {
+    unsigned count = sqlite3_column_int( handle, 1 );
+    entry.kind_counts[(RCDependencyTarget) sqlite3_column_int( handle, 0 )] = count;
+    entry.resolvables += count;
+  }
+  if (rc != SQLITE_DONE)
+    ERR << "Error counting catalog " << catalog << ": " << sqlite3_errmsg (db) << endl;
+  sqlite3_finalize( handle );
+  return (rc == SQLITE_DONE);
+}
+
+
 DBCatalogEntry DbAccess::getCatalogEntry( const std::string &catalog )
 {
-  // FIXME
-  return DBCatalogEntry();
+  XXX << "DbAccess::getCatalogEntry(" << catalog << ")" << endl;
+
+  DBCatalogEntry entry;
+
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "SELECT name, alias, description, checksum, timestamp FROM catalogs WHERE id = ?" );
+  if (handle == NULL)
+    return entry;
+
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  int rc = sqlite3_step( handle );
+  if (rc == SQLITE_ROW)
+  {
+    entry.catalog = catalog;
+    const char *text = (const char *) sqlite3_column_text( handle, 0 );
+    if (text != NULL)
+      entry.name = text;
+    text = (const char *) sqlite3_column_text( handle, 1 );
+    if (text != NULL)
+      entry.alias = text;
+    text = (const char *) sqlite3_column_text( handle, 2 );
+    if (text != NULL)
+      entry.description = text;
+    text = (const char *) sqlite3_column_text( handle, 3 );
+    if (text != NULL)
+      entry.checksum = text;
+    entry.timestamp = zypp::Date( sqlite3_column_int( handle, 4 ) );
+  }
+  else if (rc != SQLITE_DONE)
+  {
+    ERR << "rc " << rc << ": " << sqlite3_errmsg (_db) << endl;
+  }
+  sqlite3_reset( handle );
+
+  if (entry.catalog.empty())
+    return entry;
+
+  // rows of a sharded catalog live in its shard,
+  //  those of a shared one belong to another catalog
+
+  sqlite_int64 id;
+  string file;
+  string content = contentOf( catalog );
+  if (!shardOf( content, id, file ))
+  {
+    count_catalog( _db, content, entry );
+  }
+  else
+  {
+    sqlite3 *shard = NULL;
+    if (sqlite3_open( file.c_str(), &shard ) == SQLITE_OK)
+      count_catalog( shard, content, entry );
+    else
+      ERR << "Can not open shard " << file << ": " << sqlite3_errmsg (shard) << endl;
+    sqlite3_close( shard );
+  }
+
+  return entry;
 }
 
 /** insert catalog */
@@ -1386,7 +2336,7 @@ DbAccess::insertCatalog( const DBCatalogEntry &entry  )
 {
   string query ("INSERT INTO catalogs(id,name,alias,description) VALUES (?,?,?,?) ");
 
-  sqlite3_stmt *handle = prepare_handle( _db, query );
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( query );
   if (handle == NULL)
   {
     return false;
@@ -1418,7 +2368,7 @@ DbAccess::updateCatalog( const DBCatalogEntry &entry )
   //                    0    1     2
   string query ("SELECT name,alias,description FROM catalogs WHERE id = ? ");
 
-  sqlite3_stmt *sel_handle = prepare_handle( _db, query );
+  sqlite3_stmt *sel_handle = DbStatementCache::of( _db ).get( query );
   if (sel_handle == NULL)
   {
     ERR << "Can't prepare SELECT query: " << sqlite3_errmsg (_db) << endl;
@@ -1483,7 +2433,7 @@ DbAccess::updateCatalog( const DBCatalogEntry &entry )
 
   //                                  1          2                3            4
   query = "UPDATE catalogs SET name = ?, alias = ?, description = ? WHERE id = ?";
-  sqlite3_stmt *upd_handle = prepare_handle( _db, query );
+  sqlite3_stmt *upd_handle = DbStatementCache::of( _db ).get( query );
   if (upd_handle == NULL)
   {
     ERR << "Can't prepare UPDATE query: " << sqlite3_errmsg (_db) << endl;
@@ -1512,9 +2462,13 @@ DbAccess::updateCatalog( const DBCatalogEntry &entry )
 bool
 DbAccess::removeCatalog( const std::string & catalog )
 {
+  _dep_writer.flush();
+  removeShard( catalog );
+  unshareCatalog( catalog );
+
   string query ("DELETE FROM catalogs where id = ? ");
 
-  sqlite3_stmt *handle = prepare_handle( _db, query );
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( query );
   if (handle == NULL)
   {
     return false;
@@ -1529,24 +2483,76 @@ DbAccess::removeCatalog( const std::string & catalog )
   }
   sqlite3_reset( handle);
 
+  if (rc == SQLITE_DONE)
+    updateCatalogRange( catalog );	// drops the range with the rows
+
   return (rc == SQLITE_DONE);
 }
 
 
+// tables keyed by resolvables.id, emptied by range before the resolvables (see emptyCatalog())
+
+static const char *range_tables[] = {
+  "dependencies",
+  "resolvable_fingerprints",
+  "resolvable_dep_sets",
+  "resolvable_dep_blobs",
+  "file_provides",
+  "file_requires",
+  NULL
+};
+
 /** empty catalog, remove all resolvables belonging to this catalog */
 /* parameter 'const char ** because of callers */
 bool
 DbAccess::emptyCatalog( const std::string &catalog )
 {
-  string query ("DELETE FROM resolvables where catalog = ? ");
+  _dep_writer.flush();		// don't leave dependencies of deleted resolvables behind
+  removeShard( catalog );
+  unshareCatalog( catalog );
 
-  sqlite3_stmt *handle = prepare_handle( _db, query );
+  // if the catalog owns all ids of its range, delete by range scans
+  //  the per-row triggers then find nothing left to delete
+
+  sqlite_int64 first, last, count;
+  bool by_range = catalogRange( catalog, first, last, count )
+                  && count == last - first + 1;
+
+  if (by_range)
+  {
+    for (const char **table = range_tables; *table != NULL; ++table)
+    {
+      sqlite3_stmt *handle = DbStatementCache::of( _db ).get( string( "DELETE FROM " ) + *table + " WHERE resolvable_id BETWEEN ? AND ?" );
+      if (handle == NULL)
+        return false;
+      sqlite3_bind_int64( handle, 1, first );
+      sqlite3_bind_int64( handle, 2, last );
+      int rc = sqlite3_step( handle );
+      sqlite3_reset( handle );
+      if (rc != SQLITE_DONE)
+      {
+        ERR << "rc " << rc << ", Error emptying " << *table << ": " << sqlite3_errmsg (_db) << endl;
+        return false;
+      }
+    }
+  }
+
+  string query (by_range
+                ? "DELETE FROM resolvables where +catalog = ? AND id BETWEEN ? AND ?"
+                : "DELETE FROM resolvables where catalog = ? ");
+
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( query );
   if (handle == NULL)
   {
     return false;
   }
 
   sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  if (by_range)
+  {
+    sqlite3_bind_int64( handle, 2, first );
+    sqlite3_bind_int64( handle, 3, last );
+  }
 
   int rc = sqlite3_step( handle);
   if (rc != SQLITE_DONE)
@@ -1555,48 +2561,198 @@ DbAccess::emptyCatalog( const std::string &catalog )
   }
   sqlite3_reset( handle);
 
+  if (rc == SQLITE_DONE)
+    updateCatalogRange( catalog );
+
   return (rc == SQLITE_DONE);
 }
 
-//----------------------------------------------------------------------------
-// store
 
-void
-DbAccess::writeStore( const zypp::ResStore & store, ResStatus status, const char *catalog, Ownership owner )
+// resolvables.id range of catalog as recorded by updateCatalogRange(), false if none
+//  All resolvables of the catalog have ids in [first, last], if count is the
+//  size of the range no other catalog has ids in it.
+
+bool
+DbAccess::catalogRange( const std::string & catalog, sqlite_int64 & first, sqlite_int64 & last, sqlite_int64 & count )
 {
-  XXX << "DbAccess::writeStore()" << endl;
+  if (!catalogRangesValid( _db ))
+    return false;
 
-  if (store.empty())
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "SELECT first_id, last_id, count FROM catalog_ranges WHERE catalog = ?" );
+  if (handle == NULL)
+    return false;
+
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  bool result = false;
+  if (sqlite3_step( handle ) == SQLITE_ROW)
   {
-    ERR << "Store is empty." << endl;
-    return;
+    first = sqlite3_column_int64( handle, 0 );
+    last = sqlite3_column_int64( handle, 1 );
+    count = sqlite3_column_int64( handle, 2 );
+    result = true;
   }
+  sqlite3_reset( handle );
+  return result;
+}
 
-  //emptyCatalog( catalog );
 
-  Arch sysarch = getZYpp()->architecture();
+// record the resolvables.id range of catalog
+//  A single writeStore() inserts with ascending ids, so a freshly written
+//  catalog owns a contiguous range, a diffing syncStore() may split it.
+//  Only backend writes record ranges, see catalogRangesValid() for
+//  everybody else.
 
-  int count = 0;
-  sqlite_int64 rowid = 0;
-  for (ResStore::const_iterator iter = store.begin(); iter != store.end(); ++iter)
-  {
-    ResObject::constPtr obj = *iter;
-    if (!obj)
+bool
+DbAccess::updateCatalogRange( const std::string & catalog )
+{
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "SELECT MIN(id), MAX(id), COUNT(*) FROM main.resolvables WHERE catalog = ?" );
+  if (handle == NULL)
+    return false;
+
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  sqlite_int64 first = 0, last = 0, count = 0;
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    first = sqlite3_column_int64( handle, 0 );
+    last = sqlite3_column_int64( handle, 1 );
+    count = sqlite3_column_int64( handle, 2 );
+  }
+  sqlite3_reset( handle );
+
+  handle = DbStatementCache::of( _db ).get( (count > 0)
+                                ? "INSERT OR REPLACE INTO catalog_ranges (catalog, first_id, last_id, count) VALUES (?, ?, ?, ?)"
+                                : "DELETE FROM catalog_ranges WHERE catalog = ?" );
+  if (handle == NULL)
+    return false;
+
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  if (count > 0)
+  {
+    sqlite3_bind_int64( handle, 2, first );
+    sqlite3_bind_int64( handle, 3, last );
+    sqlite3_bind_int64( handle, 4, count );
+  }
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error recording id range of " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+
+  DBG << "Catalog " << catalog << ": " << count << " resolvables in [" << first << ", " << last << "]" << endl;
+  return stampCatalogRanges();
+}
+
+
+// remember the top resolvables row, the recorded ranges are up to date with it
+
+bool
+DbAccess::stampCatalogRanges( void )
+{
+  if (!exec_sql( _db, "DELETE FROM main.catalog_ranges_top" )
+      || !exec_sql( _db, "INSERT INTO main.catalog_ranges_top (id, catalog)"
+                         " SELECT id, catalog FROM main.resolvables ORDER BY id DESC LIMIT 1" ))
+  {
+    ERR << "Error recording top of catalog ranges" << endl;
+    return false;
+  }
+  return true;
+}
+
+
+// recompute the ranges of all catalogs from scratch, one pass over resolvables
+
+bool
+DbAccess::rebuildCatalogRanges( void )
+{
+  MIL << "Resolvables written behind our back, recomputing catalog ranges" << endl;
+  if (!exec_sql( _db, "DELETE FROM main.catalog_ranges" )
+      || !exec_sql( _db, "INSERT INTO main.catalog_ranges (catalog, first_id, last_id, count)"
+                         " SELECT catalog, MIN(id), MAX(id), COUNT(*) FROM main.resolvables WHERE catalog IS NOT NULL GROUP BY catalog" ))
+  {
+    ERR << "Error recomputing catalog ranges" << endl;
+    return false;
+  }
+  return stampCatalogRanges();
+}
+
+
+// check if the recorded ranges can be used
+//  zmd inserts and deletes resolvables without maintaining the ranges.
+//  New rows get ids past the top row, so as long as the top row is the
+//  one seen when the ranges were last recorded, nobody else wrote.
+
+bool
+DbAccess::catalogRangesValid( sqlite3 *db )
+{
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare( db,
+                       "SELECT t.id, t.catalog, r.catalog FROM main.catalog_ranges_top t"
+                       " LEFT JOIN main.resolvables r ON r.id = t.id"
+                       " WHERE t.id = (SELECT MAX(id) FROM main.resolvables)", -1, &handle, NULL ) != SQLITE_OK)
+  {
+    sqlite3_finalize( handle );
+    return false;			// db not written by this backend yet
+  }
+
+  bool valid = false;
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    const char *stamped = (const char *) sqlite3_column_text( handle, 1 );
+    const char *found = (const char *) sqlite3_column_text( handle, 2 );
+    valid = (stamped != NULL
+             && found != NULL
+             && strcmp( stamped, found ) == 0);
+  }
+  sqlite3_finalize( handle );
+  return valid;
+}
+
+//----------------------------------------------------------------------------
+// store
+
+// check if obj should go to the db at all
+
+static bool
+want_resobject( ResObject::constPtr obj, ResStatus status, const Arch & sysarch )
+{
+  return (obj->kind() != ResTraits<SrcPackage>::kind		// don't write src/nosrc packages
+          && ( status == ResStatus::installed			// installed ones are ok
+               || obj->kind() == ResTraits<Atom>::kind		//  and atoms because we need them for multi-arch patch requirements
+               || obj->arch().compatibleWith( sysarch ) ) );	//   and architecturally compatible ones
+}
+
+void
+DbAccess::writeStore( const zypp::ResStore & store, ResStatus status, const char *catalog, Ownership owner )
+{
+  XXX << "DbAccess::writeStore()" << endl;
+
+  if (store.empty())
+  {
+    ERR << "Store is empty." << endl;
+    return;
+  }
+
+  //emptyCatalog( catalog );
+
+  Arch sysarch = getZYpp()->architecture();
+
+  vector<ResObject::constPtr> objects;
+  for (ResStore::const_iterator iter = store.begin(); iter != store.end(); ++iter)
+  {
+    ResObject::constPtr obj = *iter;
+    if (!obj)
     {
       WAR << "Huh ? No object ?" << endl;
       continue;
     }
 
-    if (obj->kind() != ResTraits<SrcPackage>::kind		// don't write src/nosrc packages
-        && ( status == ResStatus::installed			// installed ones are ok
-             || obj->kind() == ResTraits<Atom>::kind		//  and atoms because we need them for multi-arch patch requirements
-             || obj->arch().compatibleWith( sysarch ) ) )	//   and architecturally compatible ones
+    if (obj->kind() == ResTraits<SystemResObject>::kind)
+      continue;
+    if (want_resobject( obj, status, sysarch ))
     {
-      rowid = writeResObject( obj, status, catalog, owner );
-      if (rowid < 0)		// rowid < 0 means 'error'
-        break;
-      if (rowid > 0)		// rowid == 0 means 'skip'
-        ++count;
+      objects.push_back( obj );
     }
     else
     {
@@ -1604,10 +2760,184 @@ DbAccess::writeStore( const zypp::ResStore & store, ResStatus status, const char
     }
   }
 
+  bool bulk = wantBulkLoad( catalog, objects.size() )
+              && beginBulkLoad();
+
+  sqlite_int64 rowid = 0;
+  int count = writeObjects( objects, status, catalog, owner, rowid );
+  if (count < 0)
+    ERR << "Writing resolvables failed" << endl;
+
   MIL << "Wrote " << count << " resolvables to database, last rowid " << rowid << endl;
+
+  if (bulk)
+    endBulkLoad();
+  if (!_staging)			// recorded by commitStaging() then
+    updateCatalogRange( catalog );
   return;
 }
 
+
+// resolvables row as seen by syncStore()
+
+struct RowInfo
+{
+  sqlite_int64 id;
+  sqlite_int64 fingerprint;
+  bool have_fingerprint;
+};
+typedef map<string, RowInfo> RowMap;
+
+// refresh catalog from store
+//  rows are matched by catalog, kind, name, edition and arch. Unchanged
+//  rows (same fingerprint) are kept, changed ones rewritten, new ones
+//  inserted and rows not in the store anymore are deleted. All deletes
+//  go first, the inserts may then run as bulk load (see beginBulkLoad()).
+//  New ids go past all other catalogs, so the catalog's id range may
+//  get holes and interleave with others, range scans then fall back to
+//  the catalog column (see updateCatalogRange()).
+// return false on error, the catalog is in an undefined state then
+
+bool
+DbAccess::syncStore( const zypp::ResStore & store, ResStatus status, const char *catalog, Ownership owner, DBSyncCounts & counts )
+{
+  XXX << "DbAccess::syncStore(" << catalog << ")" << endl;
+
+  RowMap rows;
+
+  counts = DBSyncCounts();
+
+  // rows shared with other catalogs go to one of them, they keep the old content
+  //  (staged, commitStaging() does this)
+  if (!_staging)
+    unshareCatalog( catalog );
+
+  // read what is in the catalog now
+
+  string query (
+    //      0     1       2          3          4        5       6
+    "SELECT r.id, r.name, r.version, r.release, r.epoch, r.arch, r.kind, "
+    //      7
+    "       f.fingerprint "
+    "FROM resolvables r LEFT JOIN resolvable_fingerprints f ON f.resolvable_id = r.id "
+    "WHERE r.catalog = ?");
+
+  sqlite3_stmt *handle = prepare_handle( _db, query );
+  if (handle == NULL)
+  {
+    return false;
+  }
+
+  sqlite3_bind_text( handle, 1, catalog, -1, SQLITE_STATIC );
+
+  int rc;
+  while ((rc = sqlite3_step( handle )) == SQLITE_ROW)
+  {
+    const char *name = (const char *) sqlite3_column_text( handle, 1 );
+    const char *version = (const char *) sqlite3_column_text( handle, 2 );
+    const char *release = (const char *) sqlite3_column_text( handle, 3 );
+
+    RowInfo info;
+    info.id = sqlite3_column_int64( handle, 0 );
+    info.have_fingerprint = (sqlite3_column_type( handle, 7 ) != SQLITE_NULL);
+    info.fingerprint = sqlite3_column_int64( handle, 7 );
+
+    string key = resobject_key( sqlite3_column_int( handle, 6 ),
+                                name ? name : "",
+                                version ? version : "",
+                                release ? release : "",
+                                sqlite3_column_int( handle, 4 ),
+                                sqlite3_column_int( handle, 5 ) );
+
+    if (!rows.insert( make_pair( key, info ) ).second)		// duplicate row, drop it
+    {
+      WAR << "Duplicate " << key << " in catalog " << catalog << endl;
+      info.have_fingerprint = false;
+      rows[key + "|" + str::numstring( info.id )] = info;
+    }
+  }
+  sqlite3_finalize( handle );
+
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error reading catalog " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+
+  MIL << "Catalog " << catalog << " has " << rows.size() << " resolvables" << endl;
+
+  // now compare with the store
+
+  Arch sysarch = getZYpp()->architecture();
+  vector<ResObject::constPtr> writes;
+
+  for (ResStore::const_iterator iter = store.begin(); iter != store.end(); ++iter)
+  {
+    ResObject::constPtr obj = *iter;
+    if (!obj)
+    {
+      WAR << "Huh ? No object ?" << endl;
+      continue;
+    }
+
+    if (obj->kind() == ResTraits<SystemResObject>::kind
+        || !want_resobject( obj, status, sysarch ))
+    {
+      DBG << "Not writing " << *obj << endl;
+      continue;
+    }
+
+    RowMap::iterator it = rows.find( resobject_key( obj ) );
+    if (it != rows.end())
+    {
+      if (it->second.have_fingerprint
+          && it->second.fingerprint == layoutFingerprint( resobject_fingerprint( obj, status, owner ) ))
+      {
+        ++counts.kept;
+        rows.erase( it );
+        continue;
+      }
+      if (!deleteResObject( it->second.id ))
+        return false;
+      rows.erase( it );
+      ++counts.updated;
+    }
+    else
+    {
+      ++counts.added;
+    }
+    writes.push_back( obj );
+  }
+
+  // whatever is left, is gone from the store
+
+  for (RowMap::const_iterator it = rows.begin(); it != rows.end(); ++it)
+  {
+    if (!deleteResObject( it->second.id ))
+      return false;
+    ++counts.removed;
+  }
+
+  // all deletes done (they need the indexes), now write
+
+  bool bulk = wantBulkLoad( catalog, writes.size() )
+              && beginBulkLoad();
+
+  sqlite_int64 rowid;
+  if (writeObjects( writes, status, catalog, owner, rowid ) < 0)
+  {
+    if (bulk)
+      endBulkLoad();
+    return false;
+  }
+
+  if (bulk && !endBulkLoad())
+    return false;
+  if (!_staging)
+    updateCatalogRange( catalog );
+  return true;
+}
+
 //----------------------------------------------------------------------------
 // pool
 
@@ -1624,6 +2954,9 @@ DbAccess::writePool( const zypp::ResPool & pool, const char *catalog )
 
   emptyCatalog( catalog );
 
+  bool bulk = wantBulkLoad( catalog, pool.size() )
+              && beginBulkLoad();
+
   int count = 0;
   sqlite_int64 rowid = 0;
   for (ResPool::const_iterator iter = pool.begin(); iter != pool.end(); ++iter)
@@ -1636,7 +2969,964 @@ DbAccess::writePool( const zypp::ResPool & pool, const char *catalog )
   }
 
   MIL << "Wrote " << count << " resolvables to database" << endl;
+
+  if (bulk)
+    endBulkLoad();
+  if (!_staging)
+    updateCatalogRange( catalog );
   return;
 }
 
 
+
+
+//----------------------------------------------------------------------------
+// staging
+//
+// While staging, the tables written by a catalog refresh are shadowed by
+// empty TEMP tables of the same layout. All write handles are prepared
+// while the shadows exist, so the whole refresh goes to the scratch db
+// and the live catalog stays untouched (and unlocked). commitStaging()
+// then moves the rows into main in one short transaction.
+//
+// Staged rows get their own ids, counting from 1. The move shifts every
+// integer primary key past the current maximum in main and the columns
+// referring to them by the same amount. Dependency sets are matched by
+// hash, dependency names are interned on the way.
+
+// staged tables, in copy order
+//  dependency_sets, dependency_set_rows and resolvable_dep_sets are moved by hand
+
+static const char *staged_tables[] = {
+  "resolvables",
+  "package_details",
+  "delta_packages",
+  "patch_packages",
+  "patch_packages_baseversions",
+  "message_details",
+  "script_details",
+  "patch_details",
+  "pattern_details",
+  "product_details",
+  "dependencies",
+  "resolvable_fingerprints",
+  "resolvable_dep_blobs",
+  "dependency_sets",
+  "dependency_set_rows",
+  "resolvable_dep_sets",
+  "file_provides",
+  "file_requires",
+  NULL
+};
+
+
+// single integer result of query, 0 if none
+
+static sqlite_int64
+query_int( sqlite3 *db, const string & query )
+{
+  sqlite_int64 result = 0;
+  sqlite3_stmt *handle = prepare_handle( db, query );
+  if (handle == NULL)
+    return 0;
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+    result = sqlite3_column_int64( handle, 0 );
+  sqlite3_finalize( handle );
+  return result;
+}
+
+
+// 'CREATE TABLE [IF NOT EXISTS] ...' of main table as 'CREATE TEMP TABLE ...', empty if no such table
+
+static string
+temp_table_ddl( sqlite3 *db, const string & table )
+{
+  string ddl;
+  sqlite3_stmt *handle = prepare_handle( db, "SELECT sql FROM main.sqlite_master WHERE type = 'table' AND name = ?" );
+  if (handle == NULL)
+    return ddl;
+  sqlite3_bind_text( handle, 1, table.c_str(), -1, SQLITE_STATIC );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    const char *text = (const char *) sqlite3_column_text( handle, 0 );
+    if (text != NULL)
+      ddl = text;
+  }
+  sqlite3_finalize( handle );
+
+  static const string create( "CREATE TABLE" );
+  if (ddl.size() < create.size()
+      || str::toUpper( ddl.substr( 0, create.size() ) ) != create)
+  {
+    ddl.clear();
+    return ddl;
+  }
+  return "CREATE TEMP TABLE" + ddl.substr( create.size() );
+}
+
+
+// columns of staged table: (name, integer primary key?), empty if table is not staged
+
+static vector<pair<string, bool> >
+staged_columns( sqlite3 *db, const string & table )
+{
+  vector<pair<string, bool> > columns;
+  sqlite3_stmt *handle = prepare_handle( db, "PRAGMA temp.table_info(" + table + ")" );
+  if (handle == NULL)
+    return columns;
+  while (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    //  cid, name, type, notnull, dflt_value, pk
+    const char *name = (const char *) sqlite3_column_text( handle, 1 );
+    const char *type = (const char *) sqlite3_column_text( handle, 2 );
+    bool intpk = sqlite3_column_int( handle, 5 ) != 0
+                 && type != NULL && str::toUpper( type ) == "INTEGER";
+    columns.push_back( make_pair( string( name ? name : "" ), intpk ) );
+  }
+  sqlite3_finalize( handle );
+  return columns;
+}
+
+
+bool
+DbAccess::beginStaging( void )
+{
+  XXX << "DbAccess::beginStaging()" << endl;
+
+  if (_staging)
+    return true;
+  if (_insert_res_handle == NULL)
+  {
+    ERR << "Db not open for writing" << endl;
+    return false;
+  }
+
+  _dep_writer.flush();
+  _dep_set_writer.flush();
+  commit();				// nothing of main may stay locked
+
+  for (const char **table = staged_tables; *table != NULL; ++table)
+  {
+    string ddl = temp_table_ddl( _db, *table );
+    if (ddl.empty())
+    {
+      DBG << "No table " << *table << ", not staged" << endl;
+      continue;
+    }
+    if (!exec_sql( _db, ddl ))
+    {
+      dropStaging();
+      return false;
+    }
+  }
+
+  releaseHandles();			// re-prepare against the shadows
+  _staging = true;
+  if (!prepareHandles())
+  {
+    dropStaging();
+    return false;
+  }
+
+  sqlite3_exec (_db, "BEGIN", NULL, NULL, NULL);
+  MIL << "Staging started" << endl;
+  return true;
+}
+
+
+void
+DbAccess::abortStaging( void )
+{
+  XXX << "DbAccess::abortStaging()" << endl;
+
+  if (!_staging)
+    return;
+
+  sqlite3_exec (_db, "ROLLBACK", NULL, NULL, NULL);
+  dropStaging();
+  sqlite3_exec (_db, "BEGIN", NULL, NULL, NULL);
+  MIL << "Staging aborted" << endl;
+}
+
+
+// drop the shadow tables and prepare handles for the live tables again
+
+void
+DbAccess::dropStaging( void )
+{
+  releaseHandles();
+  for (const char **table = staged_tables; *table != NULL; ++table)
+  {
+    sqlite3_exec (_db, (string( "DROP TABLE IF EXISTS temp." ) + *table).c_str(), NULL, NULL, NULL);
+  }
+  _staging = false;
+  if (!prepareHandles())
+  {
+    ERR << "Can't prepare handles after staging" << endl;
+  }
+}
+
+
+// copy staged table into main, shifting ids by the offsets computed so far
+
+bool
+DbAccess::copyStaged( const string & table, map<string, sqlite_int64> & offsets )
+{
+  vector<pair<string, bool> > columns = staged_columns( _db, table );
+  if (columns.empty())
+    return true;			// not staged
+
+  // integer primary key: keep (shifted) if something may refer to it
+  sqlite_int64 pk_offset = 0;
+  for (vector<pair<string, bool> >::const_iterator it = columns.begin(); it != columns.end(); ++it)
+  {
+    if (!it->second)
+      continue;
+    if (it->first == "resolvable_id")
+      pk_offset = offsets["resolvables"];
+    else
+      pk_offset = query_int( _db, "SELECT IFNULL(MAX(" + it->first + "), 0) FROM main." + table );
+  }
+  offsets[table] = pk_offset;
+
+  string names, values;
+  for (vector<pair<string, bool> >::const_iterator it = columns.begin(); it != columns.end(); ++it)
+  {
+    const string & column( it->first );
+    string value( column );
+
+    if (it->second)
+      value += " + " + str::numstring( pk_offset );
+    else if (column == "resolvable_id")
+      value += " + " + str::numstring( offsets["resolvables"] );
+    else if (column == "package_id")			// package_details row
+      value += " + " + str::numstring( offsets["package_details"] );
+    else if (column == "patch_package_id")		// patch_packages row
+      value += " + " + str::numstring( offsets["patch_packages"] );
+
+    if (!names.empty())
+    {
+      names += ", ";
+      values += ", ";
+    }
+    names += column;
+    values += value;
+  }
+
+  return exec_sql( _db, "INSERT INTO main." + table + " (" + names + ") SELECT " + values + " FROM temp." + table );
+}
+
+
+// move staged dependency sets, reusing sets main already has
+
+bool
+DbAccess::copyStagedDependencySets( sqlite_int64 res_offset, sqlite_int64 & set_base )
+{
+  set_base = query_int( _db, "SELECT IFNULL(MAX(id), 0) FROM main.dependency_sets" );
+
+
+  return exec_sql( _db,
+                   "INSERT INTO main.dependency_sets (hash)"
+                   " SELECT hash FROM temp.dependency_sets WHERE hash NOT IN (SELECT hash FROM main.dependency_sets)" )
+         && exec_sql( _db,
+                      "INSERT INTO main.dependency_set_rows (dep_set_id, dep_type, name, version, release, epoch, arch, relation, dep_target, name_id)"
+                      " SELECT m.id, r.dep_type, r.name, r.version, r.release, r.epoch, r.arch, r.relation, r.dep_target, r.name_id"
+                      " FROM temp.dependency_set_rows r, temp.dependency_sets t, main.dependency_sets m"
+                      " WHERE r.dep_set_id = t.id AND m.hash = t.hash AND m.id > " + str::numstring( set_base ) )
+         && exec_sql( _db,
+                      "INSERT INTO main.resolvable_dep_sets (resolvable_id, dep_set_id)"
+                      " SELECT r.resolvable_id + " + str::numstring( res_offset ) + ", m.id"
+                      " FROM temp.resolvable_dep_sets r, temp.dependency_sets t, main.dependency_sets m"
+                      " WHERE r.dep_set_id = t.id AND m.hash = t.hash" );
+}
+
+
+// replace dependency names by dep_names ids in rows moved from staging
+
+bool
+DbAccess::internStagedNames( const string & table, const string & where )
+{
+  return exec_sql( _db,
+                   "INSERT OR IGNORE INTO main.dep_names (name)"
+                   " SELECT DISTINCT name FROM main." + table + " WHERE " + where + " AND name IS NOT NULL" )
+         && exec_sql( _db,
+                      "UPDATE main." + table +
+                      " SET name_id = (SELECT id FROM main.dep_names WHERE dep_names.name = " + table + ".name), name = NULL"
+                      " WHERE " + where + " AND name IS NOT NULL" );
+}
+
+
+// same for the packed dependencies moved from staging (ids > res_offset)
+//  The blobs are decoded and encoded again. They are read in batches, so
+//  no row is updated under a running scan of its table.
+
+#define INTERN_BLOB_BATCH 1000
+
+bool
+DbAccess::internStagedBlobs( sqlite_int64 res_offset )
+{
+  sqlite3_stmt *select = prepare_handle( _db,
+    "SELECT resolvable_id, deps FROM main.resolvable_dep_blobs"
+    " WHERE resolvable_id > ? ORDER BY resolvable_id LIMIT " + str::numstring( INTERN_BLOB_BATCH ) );
+  sqlite3_stmt *update = prepare_handle( _db, "UPDATE main.resolvable_dep_blobs SET deps = ? WHERE resolvable_id = ?" );
+  bool result = (select != NULL && update != NULL);
+  sqlite_int64 last = res_offset;
+  unsigned interned = 0;
+
+  while (result)
+  {
+    vector<pair<sqlite_int64, string> > blobs;
+    sqlite3_bind_int64( select, 1, last );
+    int rc;
+    while ((rc = sqlite3_step( select )) == SQLITE_ROW)
+    {
+      const char *blob = (const char *) sqlite3_column_blob( select, 1 );
+      blobs.push_back( make_pair( sqlite3_column_int64( select, 0 ),
+                                  string( blob ? blob : "", sqlite3_column_bytes( select, 1 ) ) ) );
+    }
+    sqlite3_reset( select );
+    if (rc != SQLITE_DONE)
+    {
+      ERR << "Error reading staged dependencies: " << sqlite3_errmsg (_db) << endl;
+      result = false;
+      break;
+    }
+    if (blobs.empty())
+      break;
+
+    for (vector<pair<sqlite_int64, string> >::const_iterator it = blobs.begin(); it != blobs.end(); ++it)
+    {
+      last = it->first;
+      vector<DbDependencyRow> rows;
+      if (!dep_blob_decode( it->second.data(), it->second.size(), rows ))
+      {
+        WAR << "Can't decode dependencies of " << it->first << ", left as is" << endl;
+        continue;
+      }
+
+      bool changed = false;
+      for (vector<DbDependencyRow>::iterator row = rows.begin(); row != rows.end(); ++row)
+      {
+        if (row->name_id > 0)
+          continue;
+        row->name_id = depNameId( row->name );
+        if (row->name_id > 0)
+        {
+          row->name.clear();
+          changed = true;
+        }
+      }
+      if (!changed)
+        continue;
+
+      string blob;
+      dep_blob_encode( rows, blob );
+      sqlite3_bind_blob( update, 1, blob.data(), blob.size(), SQLITE_STATIC );
+      sqlite3_bind_int64( update, 2, it->first );
+      rc = sqlite3_step( update );
+      sqlite3_reset( update );
+      if (rc != SQLITE_DONE)
+      {
+        ERR << "Error interning dependencies of " << it->first << ": " << sqlite3_errmsg (_db) << endl;
+        result = false;
+        break;
+      }
+      ++interned;
+    }
+  }
+
+  sqlite3_finalize( select );
+  sqlite3_finalize( update );
+  if (result)
+    DBG << interned << " staged dependency blobs interned" << endl;
+  return result;
+}
+
+
+bool
+DbAccess::commitStaging( const std::string & catalog )
+{
+  XXX << "DbAccess::commitStaging(" << catalog << ")" << endl;
+
+  if (!_staging)
+  {
+    ERR << "Not staging" << endl;
+    return false;
+  }
+
+  _dep_writer.flush();
+  _dep_set_writer.flush();
+  commit();				// the staged rows, temp only
+
+  // from here on main is locked
+
+  sqlite3_busy_timeout( _db, 30000 );	// zmd or another helper may be reading
+  if (!exec_sql( _db, "BEGIN IMMEDIATE" ))
+  {
+    abortStaging();
+    return false;
+  }
+
+  unshareCatalog( catalog );		// other catalogs keep the old rows
+
+  bool result = false;
+  map<string, sqlite_int64> offsets;
+  sqlite_int64 res_offset, set_base;
+  sqlite3_stmt *handle = NULL;
+  int rc;
+
+  // the stored checksum only vouches for a completely written catalog,
+  //  the caller records the new one after this commit (nothing to clear in a shard)
+
+  handle = prepare_handle( _db, "UPDATE main.catalogs SET checksum = '' WHERE id = ?" );
+  if (handle == NULL)
+    goto cleanup;
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  rc = sqlite3_step( handle );
+  sqlite3_finalize( handle );
+  handle = NULL;
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error clearing checksum of " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+    goto cleanup;
+  }
+
+  // copy first, then delete the old rows (ids <= res_offset)
+
+  for (const char **table = staged_tables; *table != NULL; ++table)
+  {
+    string name( *table );
+    if (name == "dependency_sets" || name == "dependency_set_rows" || name == "resolvable_dep_sets")
+      continue;
+    if (!copyStaged( name, offsets ))
+      goto cleanup;
+  }
+  res_offset = offsets["resolvables"];
+
+  if (!copyStagedDependencySets( res_offset, set_base ))
+    goto cleanup;
+
+  if (_intern_dep_names
+      && (!internStagedNames( "dependencies", "resolvable_id > " + str::numstring( res_offset ) )
+          || !internStagedNames( "dependency_set_rows", "dep_set_id > " + str::numstring( set_base ) )
+          || !internStagedBlobs( res_offset )))
+  {
+    goto cleanup;
+  }
+
+  handle = prepare_handle( _db, "DELETE FROM main.resolvables WHERE catalog = ? AND id <= ?" );
+  if (handle == NULL)
+    goto cleanup;
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_int64( handle, 2, res_offset );
+  if (sqlite3_step( handle ) != SQLITE_DONE)
+  {
+    ERR << "Error removing old catalog " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+    goto cleanup;
+  }
+
+  updateCatalogRange( catalog );	// the copied rows are contiguous
+  result = true;
+
+cleanup:
+  sqlite3_finalize( handle );
+  if (result
+      && !commit())
+  {
+    result = false;
+  }
+  if (result)
+  {
+    MIL << "Staged catalog " << catalog << " committed" << endl;
+  }
+  else
+  {
+    ERR << "Moving staged catalog " << catalog << " failed, left untouched" << endl;
+    sqlite3_exec (_db, "ROLLBACK", NULL, NULL, NULL);
+    _dep_name_ids.clear();		// may hold ids of rolled back dep_names rows
+  }
+
+  dropStaging();
+  sqlite3_exec (_db, "BEGIN", NULL, NULL, NULL);
+  return result;
+}
+
+
+//----------------------------------------------------------------------------
+// shards
+//
+// A sharded catalog keeps its resolvables, details and dependencies in a
+// db file of its own, <dbfile>.shard<id>, listed in catalog_shards. The
+// shard gets a copy of the zmd schema (tables, indices, triggers and
+// views), so it is written by a DbAccess and read by a DbSourceImpl
+// exactly like the main db. Emptying or removing the catalog just
+// unlinks the file.
+
+bool
+DbAccess::shardOf( const std::string & catalog, sqlite_int64 & id, std::string & file )
+{
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "SELECT id, file FROM catalog_shards WHERE catalog = ?" );
+  if (handle == NULL)
+    return false;
+
+  bool found = false;
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    id = sqlite3_column_int64( handle, 0 );
+    const char *text = (const char *) sqlite3_column_text( handle, 1 );
+    file = text ? text : "";
+    found = true;
+  }
+  sqlite3_reset( handle );
+  return found;
+}
+
+
+void
+DbAccess::removeShard( const std::string & catalog )
+{
+  sqlite_int64 id;
+  string file;
+  if (!shardOf( catalog, id, file ))
+    return;
+
+  MIL << "Removing shard " << file << " of catalog " << catalog << endl;
+  if (unlink( file.c_str() ) != 0)
+    WAR << "Can't unlink " << file << endl;
+
+  sqlite3_stmt *handle = prepare_handle( _db, "DELETE FROM catalog_shards WHERE id = ?" );
+  if (handle == NULL)
+    return;
+  sqlite3_bind_int64( handle, 1, id );
+  if (sqlite3_step( handle ) != SQLITE_DONE)
+    ERR << "Error removing shard of " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+  sqlite3_finalize( handle );
+}
+
+
+// copy schema of db to the (new, empty) file
+
+static bool
+create_shard_file( sqlite3 *db, const string & file )
+{
+  unlink( file.c_str() );
+
+  sqlite3 *shard = NULL;
+  if (sqlite3_open( file.c_str(), &shard ) != SQLITE_OK)
+  {
+    ERR << "Can't create shard " << file << ": " << sqlite3_errmsg (shard) << endl;
+    sqlite3_close( shard );
+    return false;
+  }
+
+  // tables first, the rest refers to them
+  sqlite3_stmt *handle = prepare_handle( db,
+    "SELECT sql FROM main.sqlite_master "
+    "WHERE sql NOT NULL AND name NOT LIKE 'sqlite_%' AND tbl_name != 'catalog_shards' "
+    "ORDER BY CASE type WHEN 'table' THEN 0 WHEN 'index' THEN 1 WHEN 'view' THEN 2 ELSE 3 END" );
+
+  bool result = (handle != NULL);
+  sqlite3_exec( shard, "BEGIN", NULL, NULL, NULL );
+  while (result
+         && sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    result = exec_sql( shard, (const char *) sqlite3_column_text( handle, 0 ) );
+  }
+  sqlite3_finalize( handle );
+  sqlite3_exec( shard, result ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL );
+  sqlite3_close( shard );
+
+  if (!result)
+    unlink( file.c_str() );
+  return result;
+}
+
+
+DbAccess_Ptr
+DbAccess::openShard( const std::string & catalog )
+{
+  XXX << "DbAccess::openShard(" << catalog << ")" << endl;
+
+  sqlite_int64 id;
+  string file;
+
+  if (!shardOf( catalog, id, file ))
+  {
+    // moving catalog to a shard, drop what is left in the main db
+    if (!emptyCatalog( catalog ))
+      return NULL;
+
+    sqlite3_stmt *handle = prepare_handle( _db, "INSERT INTO catalog_shards (catalog, file) VALUES (?, '')" );
+    if (handle == NULL)
+      return NULL;
+    sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+    int rc = sqlite3_step( handle );
+    sqlite3_finalize( handle );
+    if (rc != SQLITE_DONE)
+    {
+      ERR << "Error adding shard of " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+      return NULL;
+    }
+    id = sqlite3_last_insert_rowid( _db );
+    file = _dbfile + ".shard" + str::numstring( id );
+
+    handle = prepare_handle( _db, "UPDATE catalog_shards SET file = ? WHERE id = ?" );
+    if (handle == NULL)
+      return NULL;
+    sqlite3_bind_text( handle, 1, file.c_str(), -1, SQLITE_STATIC );
+    sqlite3_bind_int64( handle, 2, id );
+    rc = sqlite3_step( handle );
+    sqlite3_finalize( handle );
+
+    if (rc != SQLITE_DONE
+        || !create_shard_file( _db, file ))
+    {
+      removeShard( catalog );
+      return NULL;
+    }
+    MIL << "Created shard " << file << " for catalog " << catalog << endl;
+  }
+
+  DbAccess_Ptr shard = new DbAccess( file );
+  shard->_intern_dep_names = _intern_dep_names;
+  shard->_share_dep_sets = _share_dep_sets;
+  shard->_pack_deps = _pack_deps;
+  shard->_split_file_provides = _split_file_provides;
+  shard->setDependencyBatchWidth( _dep_writer.width() );
+  shard->setBulkLoadThreshold( _bulk_threshold );
+  shard->setChunkSize( _chunk_size );
+  shard->setReportProgress( _report_progress );
+  shard->setPackText( _pack_text );
+
+  if (!shard->openDb( true ))
+    return NULL;
+  return shard;
+}
+
+
+//----------------------------------------------------------------------------
+// shared catalogs
+//
+// Catalogs with identical metadata (a mirror and its original, one repo
+// reached by two urls) keep a single set of resolvables. catalog_content
+// lists the catalog holding the rows of each catalog written by
+// parse-metadata, the catalog itself unless it shares the rows of another
+// one. A catalog's rows are only shared while their checksum matches, so
+// emptying a catalog whose rows are shared hands them to one of its
+// sharers first (see unshareCatalog()).
+
+std::string
+DbAccess::contentOf( const std::string & catalog )
+{
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "SELECT content FROM catalog_content WHERE catalog = ?" );
+  if (handle == NULL)
+    return catalog;
+
+  string content( catalog );
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    const char *text = (const char *) sqlite3_column_text( handle, 0 );
+    if (text != NULL)
+      content = text;
+  }
+  sqlite3_reset( handle );
+  return content;
+}
+
+
+bool
+DbAccess::setCatalogContent( const std::string & catalog, const std::string & content, Ownership owner )
+{
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "INSERT OR REPLACE INTO catalog_content (catalog, content, owner) VALUES (?, ?, ?)" );
+  if (handle == NULL)
+    return false;
+
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 2, content.c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_int( handle, 3, owner );
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error setting content of " << catalog << ": " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+  return true;
+}
+
+
+// share the rows of another catalog written from the same metadata
+//  Only catalogs holding rows of their own in the main db qualify, the
+//  owner decides package urls and filenames, so it must match too.
+
+bool
+DbAccess::shareCatalog( const std::string & catalog, const std::string & checksum, Ownership owner )
+{
+  if (checksum.empty())
+    return false;
+
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get(
+    "SELECT catalogs.id FROM catalogs, catalog_content"
+    " WHERE catalogs.checksum = ? AND catalogs.id != ?"
+    "   AND catalog_content.catalog = catalogs.id AND catalog_content.content = catalogs.id"
+    "   AND catalog_content.owner = ?"
+    "   AND catalogs.id NOT IN (SELECT catalog FROM catalog_shards)"
+    " LIMIT 1" );
+  if (handle == NULL)
+    return false;
+
+  string content;
+  sqlite3_bind_text( handle, 1, checksum.c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 2, catalog.c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_int( handle, 3, owner );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    const char *text = (const char *) sqlite3_column_text( handle, 0 );
+    if (text != NULL)
+      content = text;
+  }
+  sqlite3_reset( handle );
+
+  if (content.empty())
+    return false;
+
+  if (!emptyCatalog( catalog )
+      || !setCatalogContent( catalog, content, owner ))
+  {
+    return false;
+  }
+  MIL << "Catalog " << catalog << " shares the resolvables of " << content << endl;
+  return true;
+}
+
+
+// catalog stops holding or sharing rows, pass its own rows to a sharer
+//  main. as commitStaging() calls this while the staged tables shadow main
+
+void
+DbAccess::unshareCatalog( const std::string & catalog )
+{
+  string content = contentOf( catalog );
+
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "DELETE FROM catalog_content WHERE catalog = ?" );
+  if (handle == NULL)
+    return;
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  sqlite3_step( handle );
+  sqlite3_reset( handle );
+
+  if (content != catalog)
+    return;			// rows of another catalog, nothing to hand over
+
+  handle = DbStatementCache::of( _db ).get( "SELECT catalog FROM catalog_content WHERE content = ? LIMIT 1" );
+  if (handle == NULL)
+    return;
+
+  string heir;
+  sqlite3_bind_text( handle, 1, catalog.c_str(), -1, SQLITE_STATIC );
+  if (sqlite3_step( handle ) == SQLITE_ROW)
+  {
+    const char *text = (const char *) sqlite3_column_text( handle, 0 );
+    if (text != NULL)
+      heir = text;
+  }
+  sqlite3_reset( handle );
+
+  if (heir.empty())
+    return;
+
+  static const char *handover[] = {
+    "UPDATE main.resolvables SET catalog = ?1 WHERE catalog = ?2",
+    "UPDATE main.catalog_ranges SET catalog = ?1 WHERE catalog = ?2",
+    "UPDATE main.catalog_content SET content = ?1 WHERE content = ?2",
+    NULL
+  };
+  for (const char **query = handover; *query != NULL; ++query)
+  {
+    handle = DbStatementCache::of( _db ).get( *query );
+    if (handle == NULL)
+      return;
+    sqlite3_bind_text( handle, 1, heir.c_str(), -1, SQLITE_STATIC );
+    sqlite3_bind_text( handle, 2, catalog.c_str(), -1, SQLITE_STATIC );
+    int rc = sqlite3_step( handle );
+    sqlite3_reset( handle );
+    if (rc != SQLITE_DONE)
+    {
+      ERR << "Error handing " << catalog << " over to " << heir << ": " << sqlite3_errmsg (_db) << endl;
+      return;
+    }
+  }
+  MIL << "Catalog " << heir << " takes over the resolvables of " << catalog << endl;
+  stampCatalogRanges();			// the top row may have changed hands
+}
+
+
+//----------------------------------------------------------------------------
+// bulk load
+//
+// Inserts into tables with secondary indexes update every index row by
+// row. For a large write into an empty catalog (initial load or full
+// refresh) the indexes of the tables written by writeStore() are dropped
+// instead and rebuilt once at the end. Ids are assigned in ascending
+// order, so the rows themselves go in primary key order anyway. Until
+// endBulkLoad() other catalogs are read without those indexes, slower
+// but correct, prepareSchema() restores them after a crash. The staged
+// tables have no secondary indexes at all.
+
+// write rows resolvables to catalog as bulk load ?
+//  The catalog must have no rows (none yet, or all deleted), so nothing
+//  of it is looked up through the dropped indexes. Without a catalog the
+//  objects go to their sources, then the whole table must be empty.
+
+bool
+DbAccess::wantBulkLoad( const char *catalog, unsigned rows )
+{
+  if (_bulk_threshold == 0
+      || _staging
+      || rows < _bulk_threshold)
+  {
+    return false;
+  }
+  if (catalog == NULL)
+    return query_int( _db, "SELECT COUNT(*) FROM main.resolvables" ) == 0;
+
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get( "SELECT 1 FROM main.resolvables WHERE catalog = ? LIMIT 1" );
+  if (handle == NULL)
+    return false;
+  sqlite3_bind_text( handle, 1, catalog, -1, SQLITE_STATIC );
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
+  return (rc == SQLITE_DONE);		// no row of catalog
+}
+
+
+bool
+DbAccess::beginBulkLoad( void )
+{
+  XXX << "DbAccess::beginBulkLoad()" << endl;
+
+  if (_bulk_load || _staging)
+    return false;
+
+  _dep_writer.flush();
+  _dep_set_writer.flush();
+
+  // unique indexes stay, they are constraints
+
+  vector<pair<string, string> > indexes;
+  sqlite3_stmt *handle = prepare_handle( _db, "SELECT name, sql FROM main.sqlite_master WHERE type = 'index' AND sql NOT NULL AND tbl_name = ?" );
+  if (handle == NULL)
+    return false;
+  for (const char **table = staged_tables; *table != NULL; ++table)
+  {
+    sqlite3_bind_text( handle, 1, *table, -1, SQLITE_STATIC );
+    while (sqlite3_step( handle ) == SQLITE_ROW)
+    {
+      string name( (const char *) sqlite3_column_text( handle, 0 ) );
+      string sql( (const char *) sqlite3_column_text( handle, 1 ) );
+      if (str::toUpper( sql.substr( 0, 13 ) ) == "CREATE UNIQUE")
+        continue;
+      indexes.push_back( make_pair( name, sql ) );
+    }
+    sqlite3_reset( handle );
+  }
+  sqlite3_finalize( handle );
+
+  if (indexes.empty())
+    return false;
+
+  // dropping indexes expires all prepared statements
+
+  // they are registered in bulk_load_indexes, so prepareSchema() can
+  //  restore them should they ever be committed dropped
+
+  releaseHandles();
+  _bulk_load = true;
+  handle = prepare_handle( _db, "INSERT OR REPLACE INTO bulk_load_indexes (name, sql) VALUES (?, ?)" );
+  for (vector<pair<string, string> >::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
+  {
+    bool dropped = false;
+    if (handle != NULL)
+    {
+      sqlite3_bind_text( handle, 1, it->first.c_str(), -1, SQLITE_STATIC );
+      sqlite3_bind_text( handle, 2, it->second.c_str(), -1, SQLITE_STATIC );
+      dropped = (sqlite3_step( handle ) == SQLITE_DONE)
+                && exec_sql( _db, "DROP INDEX main." + it->first );
+      sqlite3_reset( handle );
+    }
+    if (!dropped)
+    {
+      sqlite3_finalize( handle );
+      endBulkLoad();		// restores what was dropped so far
+      return false;
+    }
+    _bulk_indexes.push_back( *it );
+  }
+  sqlite3_finalize( handle );
+
+  if (!prepareHandles())
+  {
+    endBulkLoad();
+    return false;
+  }
+
+  MIL << "Bulk load, dropped " << _bulk_indexes.size() << " indexes" << endl;
+  return true;
+}
+
+
+bool
+DbAccess::endBulkLoad( void )
+{
+  XXX << "DbAccess::endBulkLoad()" << endl;
+
+  if (!_bulk_load)
+    return true;
+
+  _dep_writer.flush();
+  _dep_set_writer.flush();
+  releaseHandles();
+
+  bool result = true;
+  for (vector<pair<string, string> >::const_iterator it = _bulk_indexes.begin(); it != _bulk_indexes.end(); ++it)
+  {
+    if (!index_exists( _db, it->first )
+        && !exec_sql( _db, it->second ))
+    {
+      result = false;
+    }
+  }
+  if (result)
+    exec_sql( _db, "DELETE FROM bulk_load_indexes" );
+
+  // fresh statistics for the rebuilt tables, only if someone keeps statistics
+  //  at all: creating sqlite_stat1 would change zmd's query plans
+  if (query_int( _db, "SELECT COUNT(*) FROM main.sqlite_master WHERE name = 'sqlite_stat1'" ) > 0)
+  {
+    set<string> tables;
+    sqlite3_stmt *handle = prepare_handle( _db, "SELECT tbl_name FROM main.sqlite_master WHERE type = 'index' AND name = ?" );
+    for (vector<pair<string, string> >::const_iterator it = _bulk_indexes.begin(); handle != NULL && it != _bulk_indexes.end(); ++it)
+    {
+      sqlite3_bind_text( handle, 1, it->first.c_str(), -1, SQLITE_STATIC );
+      if (sqlite3_step( handle ) == SQLITE_ROW)
+        tables.insert( (const char *) sqlite3_column_text( handle, 0 ) );
+      sqlite3_reset( handle );
+    }
+    sqlite3_finalize( handle );
+    for (set<string>::const_iterator it = tables.begin(); it != tables.end(); ++it)
+    {
+      if (!exec_sql( _db, "ANALYZE main." + *it ))
+        WAR << "Can not analyze " << *it << endl;
+    }
+  }
+  _bulk_indexes.clear();
+  _bulk_load = false;
+
+  if (!prepareHandles())
+    result = false;
+
+  MIL << "Bulk load done" << (result ? "" : ", with errors") << endl;
+  return result;
+}
@@ -13,7 +13,9 @@
 #define ZMD_BACKEND_DBSOURCE_DBACCESS_H
 
 #include <iosfwd>
+#include <map>
 #include <string>
+#include <tr1/unordered_map>
 
 #include <sqlite3.h>
 
@@ -38,10 +40,15 @@
 #include <zypp/Rel.h>
 #include <zypp/Arch.h>
 
+#include "DbDependencyWriter.h"
+#include "DbResRecord.h"
+
 DEFINE_PTR_TYPE(DbAccess);
 
 typedef std::list<zypp::ResObject::constPtr> ResObjectList;
 typedef std::map<sqlite_int64, zypp::ResObject::constPtr> IdMap;
+typedef std::tr1::unordered_map<std::string, sqlite_int64> DepNameIdMap;
+typedef std::tr1::unordered_map<sqlite_int64, sqlite_int64> DepSetIdMap;
 
 //-----------------------------------------------------------------------------
 // filling of package_url and package_filename in package_details table
@@ -143,10 +150,11 @@ typedef enum {
 struct DBCatalogEntry
 {
   DBCatalogEntry()
+      : resolvables(0)
   {}
   
   DBCatalogEntry( const std::string & p_catalog, const std::string & p_name, const std::string & p_alias, const std::string & p_description )
-      : catalog(p_catalog), name(p_name), alias(p_alias), description(p_description)
+      : catalog(p_catalog), name(p_name), alias(p_alias), description(p_description), resolvables(0)
   {}
 
   std::string catalog;
@@ -156,6 +164,23 @@ struct DBCatalogEntry
   std::string checksum;
   zypp::Date timestamp;
 
+  unsigned resolvables;			// rows in the catalog, see DbAccess::getCatalogEntry()
+  std::map<RCDependencyTarget, unsigned> kind_counts;	// rows per kind
+};
+
+//-----------------------------------------------------------------------------
+// outcome of a diffing catalog refresh, see DbAccess::syncStore()
+
+struct DBSyncCounts
+{
+  DBSyncCounts()
+      : added(0), updated(0), removed(0), kept(0)
+  {}
+
+  unsigned added;		// not in catalog before, inserted
+  unsigned updated;		// same nevra and kind but changed content, rewritten
+  unsigned removed;		// not in store anymore, deleted
+  unsigned kept;		// unchanged, left alone
 };
 
 ///////////////////////////////////////////////////////////////////
@@ -173,38 +198,92 @@ private:
   sqlite3 *_db;
   sqlite3_stmt *_insert_res_handle;
 
-  sqlite3_stmt *_insert_pkg_handle;
+  sqlite3_stmt *_insert_details_handles[DbResRecord::DETAILS_COUNT];	// by record.details
   sqlite3_stmt *_insert_patch_package_handle;
   sqlite3_stmt *_insert_patch_package_baseversion_handle;
   sqlite3_stmt *_insert_delta_package_handle;
-
-  sqlite3_stmt *_insert_message_handle;
-  sqlite3_stmt *_insert_script_handle;
-  sqlite3_stmt *_insert_patch_handle;
-  sqlite3_stmt *_insert_pattern_handle;
-  sqlite3_stmt *_insert_product_handle;
-  sqlite3_stmt *_insert_dep_handle;
+  DbDependencyWriter _dep_writer;
 
   sqlite3_stmt *_update_catalog_checksum_handle;
-  
-  void commit();
+  sqlite3_stmt *_insert_fingerprint_handle;
+  sqlite3_stmt *_delete_res_handle;
+
+  bool _intern_dep_names;		// write dependencies.name_id instead of dependencies.name
+  DepNameIdMap _dep_name_ids;		// dep_names.name -> dep_names.id, filled on demand
+  sqlite3_stmt *_select_dep_name_handle;
+  sqlite3_stmt *_insert_dep_name_handle;
+
+  bool _share_dep_sets;			// write equal dependency sets once, see depSetId()
+  DbDependencyWriter _dep_set_writer;	// dependency_set_rows
+  DepSetIdMap _dep_set_ids;		// dependency_sets.hash -> dependency_sets.id
+  sqlite3_stmt *_select_dep_set_handle;
+  sqlite3_stmt *_insert_dep_set_handle;
+  sqlite3_stmt *_insert_res_dep_set_handle;
+
+  bool _pack_deps;			// write resolvable_dep_blobs instead of dependencies rows
+  sqlite3_stmt *_insert_dep_blob_handle;
+  std::vector<DbDependencyRow> _dep_rows;	// scratch for ownDependencyRows()
+  std::string _dep_blob;		// scratch for writeDependencyBlob()
+
+  bool _split_file_provides;		// write file provides to file_provides, see splitFileDependencies()
+  sqlite3_stmt *_insert_file_provide_handle;
+  sqlite3_stmt *_insert_file_require_handle;
+  std::vector<DbDependencyRow> _dep_split;	// scratch for splitFileDependencies()
+
+  bool _staging;			// writes go to the TEMP shadow tables, see beginStaging()
+  DbResRecord _record;			// scratch for writeResObject()
+
+  unsigned _bulk_threshold;		// see setBulkLoadThreshold()
+  bool _bulk_load;			// secondary indexes dropped, see beginBulkLoad()
+  std::vector<std::pair<std::string, std::string> > _bulk_indexes;	// dropped index name, sql
+  unsigned _chunk_size;			// see setChunkSize()
+  bool _report_progress;		// see setReportProgress()
+  bool _pack_text;			// see setPackText()
 
   sqlite_int64 writeResObject( zypp::ResObject::constPtr obj, zypp::ResStatus status, const char *catalog = NULL, Ownership owner = ZYPP_OWNED );
+  sqlite_int64 writeRecord( const DbResRecord & record );
+  int writeObjects( const std::vector<zypp::ResObject::constPtr> & objects, zypp::ResStatus status, const char *catalog, Ownership owner, sqlite_int64 & last_rowid );
+  bool chunkDone( unsigned done, unsigned total );
+
+  sqlite_int64 writeDetails( sqlite_int64 id, const DbResRecord & record );
+  void writePackageRpms( sqlite_int64 package_id, const DbResRecord & record );
+  sqlite_int64 writeDeltaPackage (sqlite_int64 package_id, const DbDeltaRecord &delta_pkg );
+  sqlite_int64 writePatchPackage (sqlite_int64 package_id, const DbPatchRpmRecord &patch_pkg );
+  sqlite_int64 writePatchPackageBaseversion(sqlite_int64 patch_package_id, const DbBaseVersionRecord &baseversion );
+
+  void writeDependencies( sqlite_int64 id, const DbResRecord & record );
+  void writeDependencySet( DbDependencyWriter & writer, sqlite_int64 owner_id, const std::vector<DbDependencyRow> & rows );
+  void ownDependencyRows( const std::vector<DbDependencyRow> & rows, sqlite_int64 owner_id, bool intern );
+  bool writeDependencyBlob( sqlite_int64 id, const std::vector<DbDependencyRow> & rows );
+  sqlite_int64 depSetId( sqlite_int64 hash, const std::vector<DbDependencyRow> & rows );
+  const std::vector<DbDependencyRow> & splitFileDependencies( sqlite_int64 id, const std::vector<DbDependencyRow> & rows, bool split );
+  bool writeResDepSet( sqlite_int64 id, sqlite_int64 set_id );
+  void purgeDependencySets( void );
+  sqlite_int64 layoutFingerprint( sqlite_int64 content ) const;
+  bool writeFingerprint( sqlite_int64 id, sqlite_int64 fingerprint );
+  sqlite_int64 depNameId( const std::string & name );
+  bool deleteResObject( sqlite_int64 id );
+  bool prepareSchema( void );
+  bool prepareWrite( void );
+  bool prepareHandles( void );
+  void releaseHandles( void );
 
-  sqlite_int64 writePackage( sqlite_int64 id, zypp::Package::constPtr package, Ownership owner = ZYPP_OWNED );
-  sqlite_int64 writeDeltaPackage (sqlite_int64 package_id, const zypp::packagedelta::DeltaRpm &delta_pkg );
-  sqlite_int64 writePatchPackage (sqlite_int64 package_id, const zypp::packagedelta::PatchRpm &patch_pkg );
-  sqlite_int64 writePatchPackageBaseversion(sqlite_int64 patch_package_id, const zypp::packagedelta::PatchRpm::BaseVersion &baseversion );
+  void dropStaging( void );
+  bool copyStaged( const std::string & table, std::map<std::string, sqlite_int64> & offsets );
+  bool copyStagedDependencySets( sqlite_int64 res_offset, sqlite_int64 & set_base );
+  bool internStagedNames( const std::string & table, const std::string & where );
+  bool internStagedBlobs( sqlite_int64 res_offset );
 
-  sqlite_int64 writeMessage( sqlite_int64 id, zypp::Message::constPtr message );
-  sqlite_int64 writeScript( sqlite_int64 id, zypp::Script::constPtr script );
-  sqlite_int64 writePatch( sqlite_int64 id, zypp::Patch::constPtr patch );
-  sqlite_int64 writePattern( sqlite_int64 id, zypp::Pattern::constPtr pattern );
-  sqlite_int64 writeProduct( sqlite_int64 id, zypp::Product::constPtr product );
+  void removeShard( const std::string & catalog );
+  void unshareCatalog( const std::string & catalog );
+
+  bool catalogRange( const std::string & catalog, sqlite_int64 & first, sqlite_int64 & last, sqlite_int64 & count );
+  bool updateCatalogRange( const std::string & catalog );
+  bool stampCatalogRanges( void );
+  bool rebuildCatalogRanges( void );
+
+  bool wantBulkLoad( const char *catalog, unsigned rows );
 
-  void writeDependencies( sqlite_int64 id, zypp::Resolvable::constPtr res);
-  void writeDependency( sqlite_int64 pkg_id, RCDependencyType type, const zypp::CapSet & capabilities);
-  bool prepareWrite( void );
 
 public:
   /** Ctor */
@@ -217,12 +296,62 @@ public:
   static RCArch Arch2Rc (const zypp::Arch & arch);
   static zypp::Arch Rc2Arch (RCArch rc);
 
+  /** check if table has column */
+  static bool haveColumn( sqlite3 *db, const std::string & table, const std::string & column );
+  /** check if the catalog_ranges of db are up to date, nothing was written behind the backend's back */
+  static bool catalogRangesValid( sqlite3 *db );
+
   sqlite3 *db() const
   {
     return _db;
   }
   bool openDb( bool for_writing );
   void closeDb( void );
+  /** commit the transaction openDb() began, releases all locks
+   * writes autocommit until begin() */
+  bool commit( void );
+  /** begin a deferred transaction, nothing is locked until the db is accessed */
+  bool begin( void );
+
+  /** rows per INSERT when writing dependencies, set before openDb() */
+  void setDependencyBatchWidth( unsigned width )
+  {
+    _dep_writer.setWidth( width );
+    _dep_set_writer.setWidth( width );
+  }
+
+  /** write dependency names once to dep_names and refer to them by id, set before openDb() */
+  void setInternDependencyNames( bool enabled )
+  {
+    _intern_dep_names = enabled;
+  }
+
+  /** write each distinct dependency set once and let resolvables refer to it, set before openDb() */
+  void setShareDependencySets( bool enabled )
+  {
+    _share_dep_sets = enabled;
+  }
+
+  /** pack all dependencies of a resolvable into one blob (resolvable_dep_blobs), set before openDb()
+   * shared dependency sets take precedence */
+  void setPackDependencies( bool enabled )
+  {
+    _pack_deps = enabled;
+  }
+
+  /** keep unversioned file provides out of the dependencies (file_provides), set before openDb()
+   * the backend only reads those back whose path some resolvable requires */
+  void setSplitFileProvides( bool enabled )
+  {
+    _split_file_provides = enabled;
+  }
+
+  /** store long summaries and descriptions zlib packed (see DbPackedText.h)
+   * Only the backend reads them back, leave off if zmd reads these columns. */
+  void setPackText( bool enabled )
+  {
+    _pack_text = enabled;
+  }
 
   /** check if catalog exists */
   bool haveCatalog( const std::string & catalog );
@@ -235,11 +364,75 @@ public:
   /** empty catalog, remove all resolvables belonging to this catalog  */
   bool emptyCatalog( const std::string &catalog );
 
-  /** get catalog properties  */
+  /** write a catalog refresh to scratch tables instead of the live ones
+   * the live catalog is neither touched nor locked until commitStaging() */
+  bool beginStaging( void );
+  /** replace catalog by the staged rows in one short transaction, drops the staged rows on failure
+   * the catalog checksum is cleared in the same transaction */
+  bool commitStaging( const std::string & catalog );
+  /** drop the staged rows */
+  void abortStaging( void );
+  bool staging() const
+  {
+    return _staging;
+  }
+
+  static const unsigned DEFAULT_BULK_LOAD_THRESHOLD = 5000;
+  static const unsigned DEFAULT_CHUNK_SIZE = 0;
+
+  /** while staging, commit after every rows resolvables written by writeStore()
+   * or syncStore(), keeps the journal small, 0 writes everything in one transaction
+   * Writes to the live tables are never chunked, readers must not see half a catalog,
+   * so a bounded journal needs staging (see configure_db() in parse-metadata). */
+  void setChunkSize( unsigned rows )
+  {
+    _chunk_size = rows;
+  }
+  /** report write progress on stdout as "2|done|total" (as transact does),
+   * once per chunk and when done */
+  void setReportProgress( bool enabled )
+  {
+    _report_progress = enabled;
+  }
+
+
+  /** writes of at least rows resolvables into a catalog without any resolvables
+   * run as bulk load, 0 disables bulk loads */
+  void setBulkLoadThreshold( unsigned rows )
+  {
+    _bulk_threshold = rows;
+  }
+  /** drop the secondary indexes of the tables written by writeStore()
+   * not while staging, the staged tables have no indexes anyway */
+  bool beginBulkLoad( void );
+  /** recreate the dropped indexes, ANALYZE their tables if the db has statistics */
+  bool endBulkLoad( void );
+  bool bulkLoad() const
+  {
+    return _bulk_load;
+  }
+
+  /** db of a sharded catalog, opened for writing with the options of this one
+   * creates the shard if the catalog has none yet, NULL on error */
+  DbAccess_Ptr openShard( const std::string & catalog );
+  /** find shard of catalog */
+  bool shardOf( const std::string & catalog, sqlite_int64 & id, std::string & file );
+
+  /** catalog holding the resolvables of catalog, catalog itself unless shared */
+  std::string contentOf( const std::string & catalog );
+  /** record that catalog, written for owner, keeps its resolvables in content */
+  bool setCatalogContent( const std::string & catalog, const std::string & content, Ownership owner );
+  /** empty catalog and share the rows of another catalog with the same checksum and owner
+   * false (catalog untouched) if there is none */
+  bool shareCatalog( const std::string & catalog, const std::string & checksum, Ownership owner );
+
+  /** get catalog properties and row counts, catalog empty if the catalog is unknown */
   DBCatalogEntry getCatalogEntry( const std::string &catalog );
 
   /** write resolvables from store to db */
   void writeStore( const zypp::ResStore & resolvables, zypp::ResStatus status, const char *catalog = NULL, Ownership owner = ZYPP_OWNED );
+  /** refresh catalog from store, only writing what differs from the rows already in the db */
+  bool syncStore( const zypp::ResStore & resolvables, zypp::ResStatus status, const char *catalog, Ownership owner, DBSyncCounts & counts );
   /** write resolvables from pool to db */
   void writePool( const zypp::ResPool & pool, const char *catalog = NULL );
   void updateCatalogChecksum( const std::string &catalog, const std::string &checksum, const zypp::Date &timestamp );
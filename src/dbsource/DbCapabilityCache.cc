@@ -0,0 +1,119 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbCapabilityCache.cc
+ *
+*/
+
+#include <iostream>
+
+#include "zypp/base/Logger.h"
+#include "DbCapabilityCache.h"
+#include "DbAccess.h"
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "DbCapabilityCache"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+DbCapabilityCache::DbCapabilityCache()
+    : _hits( 0 )
+    , _misses( 0 )
+{
+}
+
+
+DbCapabilityCache::~DbCapabilityCache()
+{
+  if (_hits + _misses > 0)
+  {
+    MIL << _capabilities.size() << " capabilities, " << _strings.size() << " strings, "
+        << _hits << " hits, " << _misses << " misses (" << hitRate() << "% hit rate)" << endl;
+  }
+}
+
+
+// the one copy of text kept by the cache, stable while the cache lives
+
+const std::string *
+DbCapabilityCache::intern( const std::string & text )
+{
+  return &*_strings.insert( text ).first;
+}
+
+
+DbCapabilityCache::Key
+DbCapabilityCache::key( int target, const std::string & name )
+{
+  Key key;
+  key.target = target;
+  key.name = intern( name );
+  key.relation = RC_RELATION_NONE;
+  key.version = NULL;
+  key.release = NULL;
+  key.epoch = 0;
+  return key;
+}
+
+
+DbCapabilityCache::Key
+DbCapabilityCache::key( int target, const std::string & name, int relation, const std::string & version, const std::string & release, int epoch )
+{
+  Key key;
+  key.target = target;
+  key.name = intern( name );
+  key.relation = relation;
+  key.version = intern( version );
+  key.release = intern( release );
+  key.epoch = epoch;
+  return key;
+}
+
+
+const zypp::Capability *
+DbCapabilityCache::find( const Key & key )
+{
+  CapabilityMap::const_iterator it = _capabilities.find( key );
+  if (it == _capabilities.end())
+  {
+    ++_misses;
+    return NULL;
+  }
+  ++_hits;
+  return &it->second;
+}
+
+
+void
+DbCapabilityCache::insert( const Key & key, const zypp::Capability & cap )
+{
+  _capabilities.insert( make_pair( key, cap ) );
+}
+
+
+unsigned
+DbCapabilityCache::hitRate() const
+{
+  unsigned lookups = _hits + _misses;
+  return lookups > 0 ? (unsigned)((100.0 * _hits) / lookups) : 0;
+}
+
+
+size_t
+DbCapabilityCache::KeyHash::operator()( const Key & key ) const
+{
+  size_t hash = (size_t) key.name;
+  hash = hash * 31 + (size_t) key.version;
+  hash = hash * 31 + (size_t) key.release;
+  hash = hash * 31 + key.target;
+  hash = hash * 31 + key.relation;
+  hash = hash * 31 + key.epoch;
+  return hash;
+}
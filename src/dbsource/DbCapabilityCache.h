@@ -0,0 +1,100 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbCapabilityCache.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBCAPABILITYCACHE_H
+#define ZMD_BACKEND_DBSOURCE_DBCAPABILITYCACHE_H
+
+#include <string>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+
+#include "zypp/Capability.h"
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbCapabilityCache
+//
+/** Capabilities parsed while loading catalogs, keyed by dependency row
+ *
+ * The same dependency (kind, name, relation, edition) is required or
+ * provided by many resolvables. The first one parses it, all others get
+ * the same Capability from here. Names and editions are interned, so a
+ * key is a handful of pointers and ints. One cache is shared by all
+ * catalogs of a DbSources, it is not thread safe.
+*/
+
+class DbCapabilityCache
+{
+public:
+  struct Key
+  {
+    int target;				// RCDependencyTarget
+    const std::string *name;		// interned
+    int relation;			// RCResolvableRelation, RC_RELATION_NONE if unversioned
+    const std::string *version;		// interned, NULL if unversioned
+    const std::string *release;
+    int epoch;
+
+    bool operator==( const Key & rhs ) const
+    {
+      return target == rhs.target && name == rhs.name && relation == rhs.relation
+             && version == rhs.version && release == rhs.release && epoch == rhs.epoch;
+    }
+  };
+
+  /** Ctor */
+  DbCapabilityCache();
+  /** Dtor, logs the hit rate */
+  ~DbCapabilityCache();
+
+  /** key of an unversioned dependency */
+  Key key( int target, const std::string & name );
+  /** key of a versioned dependency */
+  Key key( int target, const std::string & name, int relation, const std::string & version, const std::string & release, int epoch );
+
+  /** capability of key, NULL if not parsed yet */
+  const zypp::Capability *find( const Key & key );
+  /** remember the capability parsed for key */
+  void insert( const Key & key, const zypp::Capability & cap );
+
+  unsigned hits() const
+  {
+    return _hits;
+  }
+  unsigned misses() const
+  {
+    return _misses;
+  }
+  /** hits in percent of all lookups */
+  unsigned hitRate() const;
+
+private:
+  DbCapabilityCache( const DbCapabilityCache & );
+  DbCapabilityCache & operator=( const DbCapabilityCache & );
+
+  const std::string *intern( const std::string & text );
+
+  struct KeyHash
+  {
+    size_t operator()( const Key & key ) const;
+  };
+
+  typedef std::tr1::unordered_set<std::string> StringSet;
+  typedef std::tr1::unordered_map<Key, zypp::Capability, KeyHash> CapabilityMap;
+
+  StringSet _strings;			// interned names and editions
+  CapabilityMap _capabilities;
+  unsigned _hits;
+  unsigned _misses;
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBCAPABILITYCACHE_H
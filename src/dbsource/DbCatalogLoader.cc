@@ -0,0 +1,231 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbCatalogLoader.cc
+ *
+*/
+
+#include <iostream>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "zypp/base/Logger.h"
+#include "DbCatalogLoader.h"
+#include "DbSourceImpl.h"
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "DbCatalogLoader"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+DbCatalogLoader::DbCatalogLoader( const std::string & dbfile, unsigned workers )
+    : _dbfile( dbfile )
+    , _workers( workers > 0 ? workers : 1 )
+    , _next( 0 )
+    , _wanted( -1 )
+    , _stop( false )
+{
+  pthread_mutex_init( &_lock, NULL );
+  pthread_cond_init( &_changed, NULL );
+}
+
+
+DbCatalogLoader::~DbCatalogLoader()
+{
+  pthread_mutex_lock( &_lock );
+  _stop = true;
+  pthread_cond_broadcast( &_changed );
+  pthread_mutex_unlock( &_lock );
+
+  for (vector<pthread_t>::iterator it = _threads.begin(); it != _threads.end(); ++it)
+    pthread_join( *it, NULL );
+
+  pthread_cond_destroy( &_changed );
+  pthread_mutex_destroy( &_lock );
+}
+
+
+unsigned
+DbCatalogLoader::add( const std::string & content, const std::string & shard )
+{
+  Job job;
+  job.content = content;
+  job.shard = shard;
+  _jobs.push_back( job );
+  return _jobs.size() - 1;
+}
+
+
+bool
+DbCatalogLoader::start( void )
+{
+  unsigned count = _workers < _jobs.size() ? _workers : _jobs.size();
+  for (unsigned i = 0; i < count; ++i)
+  {
+    pthread_t thread;
+    int rc = pthread_create( &thread, NULL, run, this );
+    if (rc != 0)
+    {
+      ERR << "Can't start catalog loader thread: " << strerror( rc ) << endl;
+      break;
+    }
+    _threads.push_back( thread );
+  }
+  MIL << "Reading " << _jobs.size() << " catalogs with " << _threads.size() << " threads" << endl;
+  return !_threads.empty();
+}
+
+
+bool
+DbCatalogLoader::take( unsigned job, DbDependencyRowMap & rows, std::string & error )
+{
+  if (job >= _jobs.size()
+      || _threads.empty())
+  {
+    return false;			// not started, nothing to report
+  }
+
+  pthread_mutex_lock( &_lock );
+  if ((long)job > _wanted)
+  {
+    _wanted = job;
+    pthread_cond_broadcast( &_changed );
+  }
+  while (!_jobs[job].done)
+    pthread_cond_wait( &_changed, &_lock );
+
+  Job & taken( _jobs[job] );
+  rows.swap( taken.rows );
+  taken.rows.clear();
+  error = taken.error;
+  bool result = taken.result;
+  pthread_mutex_unlock( &_lock );
+
+  return result;
+}
+
+
+void *
+DbCatalogLoader::run( void *loader )
+{
+  ((DbCatalogLoader *)loader)->work();
+  return NULL;
+}
+
+
+// open file into db, false (and error set) on failure
+
+static bool
+open_db( const string & file, sqlite3 *& db, string & error )
+{
+  if (sqlite3_open( file.c_str(), &db ) != SQLITE_OK)
+  {
+    error = "Can't open " + file + ": " + sqlite3_errmsg( db );
+    sqlite3_close( db );
+    db = NULL;
+    return false;
+  }
+  sqlite3_busy_timeout( db, 30000 );	// zmd or another helper may be writing
+  return true;
+}
+
+
+// worker thread, no logging here
+//  reads the next job as long as it is not too far ahead of take()
+
+void
+DbCatalogLoader::work( void )
+{
+  sqlite3 *db = NULL;			// connection to _dbfile, opened on first use
+
+  pthread_mutex_lock( &_lock );
+  for (;;)
+  {
+    while (!_stop
+           && _next < _jobs.size()
+           && (long)_next > _wanted + (long)_workers)
+    {
+      pthread_cond_wait( &_changed, &_lock );
+    }
+    if (_stop
+        || _next >= _jobs.size())
+    {
+      break;
+    }
+    Job & job( _jobs[_next++] );
+    pthread_mutex_unlock( &_lock );
+
+    bool result = false;
+    DbDependencyRowMap rows;
+    string error;
+    if (job.shard.empty())
+    {
+      if (db != NULL
+          || open_db( _dbfile, db, error ))
+      {
+        result = DbSourceImpl::readDependencyRows( db, job.content, rows, error );
+      }
+    }
+    else
+    {
+      sqlite3 *shard_db = NULL;
+      if (open_db( job.shard, shard_db, error ))
+      {
+        result = DbSourceImpl::readDependencyRows( shard_db, job.content, rows, error );
+        sqlite3_close( shard_db );
+      }
+    }
+
+    pthread_mutex_lock( &_lock );
+    job.rows.swap( rows );
+    job.error = error;
+    job.result = result;
+    job.done = true;
+    pthread_cond_broadcast( &_changed );
+  }
+  pthread_mutex_unlock( &_lock );
+
+  if (db != NULL)
+    sqlite3_close( db );
+}
+
+
+unsigned
+DbCatalogLoader::cpus( void )
+{
+  long count = sysconf( _SC_NPROCESSORS_ONLN );
+  return count > 0 ? count : 1;
+}
+
+
+std::string
+DbCatalogLoader::fileOf( sqlite3 *db )
+{
+  string file;
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare( db, "PRAGMA database_list", -1, &handle, NULL ) == SQLITE_OK)
+  {
+    while (sqlite3_step( handle ) == SQLITE_ROW)
+    {
+      const char *name = (const char *) sqlite3_column_text( handle, 1 );	// seq, name, file
+      const char *text = (const char *) sqlite3_column_text( handle, 2 );
+      if (name != NULL
+          && strcmp( name, "main" ) == 0
+          && text != NULL)
+      {
+        file = text;
+        break;
+      }
+    }
+  }
+  sqlite3_finalize( handle );
+  return file;
+}
@@ -0,0 +1,98 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbCatalogLoader.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBCATALOGLOADER_H
+#define ZMD_BACKEND_DBSOURCE_DBCATALOGLOADER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "DbDependencyWriter.h"
+
+/** dependency rows of a catalog by resolvable id */
+typedef std::map<sqlite_int64, std::vector<DbDependencyRow> > DbDependencyRowMap;
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbCatalogLoader
+//
+/** Reads the dependency rows of catalogs in worker threads
+ *
+ * Each worker has a connection of its own and reads whole catalogs,
+ * see DbSourceImpl::readDependencyRows(). Only plain rows are read
+ * here, the zypp objects are built by the thread calling take(), as
+ * libzypp is not thread safe. Catalogs are read in the order they were
+ * added, at most one per worker ahead of the last one asked for.
+*/
+
+class DbCatalogLoader
+{
+public:
+  /** workers reading from dbfile, nothing is read before start() */
+  DbCatalogLoader( const std::string & dbfile, unsigned workers );
+  /** Dtor, waits for the workers */
+  ~DbCatalogLoader();
+
+  /** queue catalog content, read from shard file if not empty, returns its job */
+  unsigned add( const std::string & content, const std::string & shard );
+
+  /** start the workers, false if none could be started */
+  bool start( void );
+
+  /** wait for job and hand over its rows, false if it could not be read (error set) or the workers are not running */
+  bool take( unsigned job, DbDependencyRowMap & rows, std::string & error );
+
+  /** number of cpus to use, at least 1 */
+  static unsigned cpus( void );
+
+  /** file of the main database of db, empty if in memory */
+  static std::string fileOf( sqlite3 *db );
+
+private:
+  DbCatalogLoader( const DbCatalogLoader & );
+  DbCatalogLoader & operator=( const DbCatalogLoader & );
+
+  struct Job
+  {
+    Job()
+        : done( false )
+        , result( false )
+    {}
+
+    std::string content;
+    std::string shard;
+    bool done;
+    bool result;
+    DbDependencyRowMap rows;
+    std::string error;
+  };
+
+  static void *run( void *loader );
+  void work( void );
+
+  std::string _dbfile;
+  unsigned _workers;
+  std::vector<pthread_t> _threads;
+  std::vector<Job> _jobs;
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _changed;		// job done, taken or wanted, or stopping
+  unsigned _next;			// next job to read
+  long _wanted;				// highest job asked for by take(), -1 for none
+  bool _stop;
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBCATALOGLOADER_H
@@ -0,0 +1,228 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbDependencyBlob.cc
+ *
+*/
+
+#include "DbDependencyBlob.h"
+
+using namespace std;
+
+typedef unsigned long long uint64;
+
+//----------------------------------------------------------------------------
+// encoding
+
+static void
+put_varint( string & blob, uint64 value )
+{
+  while (value >= 0x80)
+  {
+    blob += (char)((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  blob += (char)value;
+}
+
+static void
+put_signed( string & blob, long long value )
+{
+  put_varint( blob, ((uint64)value << 1) ^ (uint64)(value >> 63) );	// zigzag
+}
+
+static void
+put_string( string & blob, const string & s )
+{
+  put_varint( blob, s.size() );
+  blob += s;
+}
+
+
+void
+dep_blob_encode( const vector<DbDependencyRow> & rows, string & blob )
+{
+  blob += (char)DEP_BLOB_FORMAT;
+  put_varint( blob, rows.size() );
+
+  for (vector<DbDependencyRow>::const_iterator it = rows.begin(); it != rows.end(); ++it)
+  {
+    put_varint( blob, it->dep_type );
+    put_varint( blob, it->dep_target );
+    put_signed( blob, it->relation );
+    put_signed( blob, it->arch );
+    if (it->name_id > 0)
+    {
+      put_varint( blob, (uint64)it->name_id << 1 );
+    }
+    else
+    {
+      put_varint( blob, ((uint64)it->name.size() << 1) | 1 );
+      blob += it->name;
+    }
+    put_varint( blob, it->versioned ? 1 : 0 );
+    if (it->versioned)
+    {
+      put_signed( blob, it->epoch );
+      put_string( blob, it->version );
+      put_string( blob, it->release );
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// decoding, never trusts the blob
+
+class BlobReader
+{
+public:
+  BlobReader( const unsigned char *data, size_t size )
+      : _pos( data ), _end( data + size )
+  {}
+
+  size_t left() const
+  { return _end - _pos; }
+
+  bool varint( uint64 & value )
+  {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      if (_pos == _end)
+        return false;
+      unsigned char byte = *_pos++;
+      value |= (uint64)(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        return true;
+    }
+    return false;		// more than 10 bytes
+  }
+
+  bool integer( int & value, uint64 max )
+  {
+    uint64 v;
+    if (!varint( v ) || v > max)
+      return false;
+    value = (int)v;
+    return true;
+  }
+
+  bool signed_integer( int & value )
+  {
+    uint64 v;
+    if (!varint( v ))
+      return false;
+    long long s = (long long)(v >> 1) ^ -(long long)(v & 1);
+    if (s < -0x7fffffffLL - 1 || s > 0x7fffffffLL)
+      return false;
+    value = (int)s;
+    return true;
+  }
+
+  bool bytes( string & s, uint64 length )
+  {
+    if (length > left())
+      return false;
+    s.assign( (const char *)_pos, (size_t)length );
+    _pos += length;
+    return true;
+  }
+
+  bool str( string & s )
+  {
+    uint64 length;
+    return varint( length ) && bytes( s, length );
+  }
+
+private:
+  const unsigned char *_pos;
+  const unsigned char *_end;
+};
+
+
+static bool
+decode_row( BlobReader & reader, DbDependencyRow & row )
+{
+  uint64 name;
+  int versioned;
+
+  if (!reader.integer( row.dep_type, 0xffff )
+      || !reader.integer( row.dep_target, 0xffff )
+      || !reader.signed_integer( row.relation )
+      || !reader.signed_integer( row.arch )
+      || !reader.varint( name ))
+  {
+    return false;
+  }
+
+  if (name & 1)
+  {
+    row.name_id = 0;
+    if (!reader.bytes( row.name, name >> 1 ))
+      return false;
+  }
+  else
+  {
+    row.name_id = (sqlite_int64)(name >> 1);
+    row.name.clear();
+    if (row.name_id == 0)
+      return false;
+  }
+
+  if (!reader.integer( versioned, 1 ))
+    return false;
+  row.versioned = (versioned == 1);
+  if (row.versioned)
+  {
+    return reader.signed_integer( row.epoch )
+           && reader.str( row.version )
+           && reader.str( row.release );
+  }
+  row.epoch = 0;
+  row.version.clear();
+  row.release.clear();
+  return true;
+}
+
+
+bool
+dep_blob_decode( const void *blob, size_t size, vector<DbDependencyRow> & rows )
+{
+  rows.clear();
+  if (blob == NULL || size < 1)
+    return false;
+
+  const unsigned char *data = (const unsigned char *)blob;
+  if (data[0] != DEP_BLOB_FORMAT)
+    return false;
+
+  BlobReader reader( data + 1, size - 1 );
+  uint64 count;
+  if (!reader.varint( count )
+      || count > reader.left() / 6)		// a row takes at least 6 bytes
+  {
+    return false;
+  }
+
+  rows.resize( (size_t)count );
+  for (vector<DbDependencyRow>::iterator it = rows.begin(); it != rows.end(); ++it)
+  {
+    if (!decode_row( reader, *it ))
+    {
+      rows.clear();
+      return false;
+    }
+  }
+
+  if (reader.left() != 0)			// trailing garbage
+  {
+    rows.clear();
+    return false;
+  }
+  return true;
+}
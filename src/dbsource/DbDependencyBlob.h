@@ -0,0 +1,47 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbDependencyBlob.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBDEPENDENCYBLOB_H
+#define ZMD_BACKEND_DBSOURCE_DBDEPENDENCYBLOB_H
+
+#include <string>
+#include <vector>
+
+#include "DbDependencyWriter.h"
+
+//-----------------------------------------------------------------------------
+// all dependencies of a resolvable packed into one BLOB
+//  (resolvable_dep_blobs.deps)
+//
+// layout, all integers as LEB128 varints, signed ones zigzag encoded:
+//
+//   format		DEP_BLOB_FORMAT, one byte
+//   count		number of rows
+//   count times:
+//     dep_type, dep_target
+//     relation, arch	(signed)
+//     name		(name_id << 1) if interned, else (length << 1 | 1) followed by the bytes
+//     versioned	0 or 1, if 1 followed by
+//       epoch		(signed)
+//       version	length, bytes
+//       release	length, bytes
+//
+// resolvable_id is not part of the blob, decoded rows have it set to 0
+
+#define DEP_BLOB_FORMAT 1
+
+/** append encoded rows to blob */
+void dep_blob_encode( const std::vector<DbDependencyRow> & rows, std::string & blob );
+
+/** decode blob into rows, false (and rows empty) if the blob is malformed or of an unknown format */
+bool dep_blob_decode( const void *blob, size_t size, std::vector<DbDependencyRow> & rows );
+
+#endif // ZMD_BACKEND_DBSOURCE_DBDEPENDENCYBLOB_H
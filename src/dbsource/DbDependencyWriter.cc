@@ -0,0 +1,233 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbDependencyWriter.cc
+ *
+*/
+
+#include <iostream>
+
+#include "zypp/base/Logger.h"
+#include "DbDependencyWriter.h"
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "DbDependencyWriter"
+
+using namespace std;
+
+#define DEP_COLUMNS 10
+
+//----------------------------------------------------------------------------
+
+static sqlite3_stmt *
+prepare_dep_insert (sqlite3 *db, const string & table, const string & owner_column, bool with_name_id, unsigned width)
+{
+  string query (
+    "INSERT INTO " + table +
+    //   1                 2         3     4        5        6      7     8         9
+    "  (" + owner_column + ", dep_type, name, version, release, epoch, arch, relation, dep_target");
+  if (with_name_id)
+    query += ", name_id";	// 10
+  query += ") ";
+
+  for (unsigned i = 0; i < width; ++i)
+  {
+    if (i > 0)
+      query += " UNION ALL ";
+    query += with_name_id ? "SELECT ?, ?, ?, ?, ?, ?, ?, ?, ?, ?" : "SELECT ?, ?, ?, ?, ?, ?, ?, ?, ?";
+  }
+
+  sqlite3_stmt *handle = NULL;
+  int rc = sqlite3_prepare (db, query.c_str(), -1, &handle, NULL);
+  if (rc != SQLITE_OK)
+  {
+    ERR << "Can not prepare " << table << " insert (width " << width << "): " << sqlite3_errmsg (db) << endl;
+    sqlite3_finalize (handle);
+    return NULL;
+  }
+  return handle;
+}
+
+
+// bind row to the DEP_COLUMNS parameters starting at base (1-based)
+
+static void
+bind_row( sqlite3_stmt *handle, int base, bool with_name_id, const DbDependencyRow & row )
+{
+  sqlite3_bind_int64( handle, base + 0, row.resolvable_id );			// who issues the dependency (resolvable or set)
+  sqlite3_bind_int( handle, base + 1, row.dep_type );				// type (provides, requires, ...)
+  if (row.name_id > 0)								// tag, either interned
+  {
+    sqlite3_bind_null( handle, base + 2 );
+    sqlite3_bind_int64( handle, base + 9, row.name_id );
+  }
+  else										//  or inline
+  {
+    sqlite3_bind_text( handle, base + 2, row.name.c_str(), -1, SQLITE_STATIC );
+    if (with_name_id)
+      sqlite3_bind_null( handle, base + 9 );
+  }
+  if (row.versioned)
+  {
+    sqlite3_bind_text( handle, base + 3, row.version.c_str(), -1, SQLITE_STATIC );
+    sqlite3_bind_text( handle, base + 4, row.release.c_str(), -1, SQLITE_STATIC );
+  }
+  else
+  {
+    sqlite3_bind_null( handle, base + 3 );
+    sqlite3_bind_null( handle, base + 4 );
+  }
+  sqlite3_bind_int( handle, base + 5, row.epoch );
+  sqlite3_bind_int( handle, base + 6, row.arch );
+  sqlite3_bind_int( handle, base + 7, row.relation );				// operation (==, <, <=, ...)
+  sqlite3_bind_int( handle, base + 8, row.dep_target );				// resolvable kind the dependency refers to
+}
+
+//----------------------------------------------------------------------------
+
+DbDependencyWriter::DbDependencyWriter( unsigned width )
+    : _db( NULL )
+    , _with_name_id( true )
+    , _insert_dep_handle( NULL )
+    , _insert_dep_batch_handle( NULL )
+    , _width( 1 )
+    , _written( 0 )
+{
+  setWidth( width );
+}
+
+
+DbDependencyWriter::~DbDependencyWriter()
+{
+  close();
+}
+
+
+void
+DbDependencyWriter::setWidth( unsigned width )
+{
+  if (width < 1)
+    width = 1;
+  else if (width > MAX_WIDTH)
+    width = MAX_WIDTH;
+  _width = width;
+}
+
+
+bool
+DbDependencyWriter::prepare( sqlite3 *db, const std::string & table, const std::string & owner_column, bool with_name_id )
+{
+  close();
+
+  _db = db;
+  _table = table;
+  _with_name_id = with_name_id;
+  _insert_dep_handle = prepare_dep_insert( _db, table, owner_column, _with_name_id, 1 );
+  if (_insert_dep_handle == NULL)
+    return false;
+
+  if (_width > 1)
+  {
+    _insert_dep_batch_handle = prepare_dep_insert( _db, table, owner_column, _with_name_id, _width );
+    if (_insert_dep_batch_handle == NULL)
+      return false;
+  }
+
+  _rows.reserve( _width );
+  return true;
+}
+
+
+void
+DbDependencyWriter::close( void )
+{
+  flush();
+
+  if (_insert_dep_handle)
+  {
+    sqlite3_finalize( _insert_dep_handle );
+    _insert_dep_handle = NULL;
+  }
+  if (_insert_dep_batch_handle)
+  {
+    sqlite3_finalize( _insert_dep_batch_handle );
+    _insert_dep_batch_handle = NULL;
+  }
+  _db = NULL;
+}
+
+
+bool
+DbDependencyWriter::add( const DbDependencyRow & row )
+{
+  _rows.push_back( row );
+  if (_rows.size() >= _width)
+    return flush();
+  return true;
+}
+
+
+bool
+DbDependencyWriter::step( sqlite3_stmt *handle, vector<DbDependencyRow>::const_iterator begin, vector<DbDependencyRow>::const_iterator end )
+{
+  int base = 1;
+  for (vector<DbDependencyRow>::const_iterator it = begin; it != end; ++it)
+  {
+    bind_row( handle, base, _with_name_id, *it );
+    base += _with_name_id ? DEP_COLUMNS : DEP_COLUMNS - 1;
+  }
+
+  int rc = sqlite3_step( handle );
+  sqlite3_reset( handle );
+
+  if (rc != SQLITE_DONE)
+  {
+    ERR << "Error adding " << _table << " to SQL: " << sqlite3_errmsg (_db) << endl;
+    return false;
+  }
+  _written += (end - begin);
+  return true;
+}
+
+
+bool
+DbDependencyWriter::flush( void )
+{
+  if (_rows.empty())
+    return true;
+
+  if (_insert_dep_handle == NULL)
+  {
+    ERR << "Dependency writer not prepared, dropping " << _rows.size() << " rows" << endl;
+    _rows.clear();
+    return false;
+  }
+
+  bool result = true;
+  vector<DbDependencyRow>::const_iterator it = _rows.begin();
+
+  // full batches first, the remainder row by row
+
+  if (_insert_dep_batch_handle != NULL)
+  {
+    while (_rows.end() - it >= (int)_width)
+    {
+      if (!step( _insert_dep_batch_handle, it, it + _width ))
+        result = false;
+      it += _width;
+    }
+  }
+  for (; it != _rows.end(); ++it)
+  {
+    if (!step( _insert_dep_handle, it, it + 1 ))
+      result = false;
+  }
+
+  _rows.clear();
+  return result;
+}
@@ -0,0 +1,104 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbDependencyWriter.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBDEPENDENCYWRITER_H
+#define ZMD_BACKEND_DBSOURCE_DBDEPENDENCYWRITER_H
+
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+//-----------------------------------------------------------------------------
+// one row of the dependencies (or dependency_set_rows) table
+
+struct DbDependencyRow
+{
+  DbDependencyRow()
+      : resolvable_id(0), dep_type(0), name_id(0), versioned(false), epoch(0), arch(-1), relation(0), dep_target(0)
+  {}
+
+  sqlite_int64 resolvable_id;	// owner, resolvables.id or dependency_sets.id
+  int dep_type;			// RCDependencyType
+  sqlite_int64 name_id;		// if > 0, dep_names.id to write instead of name
+  std::string name;
+  bool versioned;		// if false, version and release are written as NULL
+  std::string version;
+  std::string release;
+  int epoch;
+  int arch;			// RCArch
+  int relation;			// RCResolvableRelation
+  int dep_target;		// RCDependencyTarget
+};
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbDependencyWriter
+//
+/** Buffered writer for the dependencies table
+ *
+ * Rows are collected and written in batches of width() rows by a single
+ * multi-row INSERT, saving most of the per-row sqlite3_step() overhead.
+ * The INSERT uses 'SELECT ... UNION ALL SELECT ...' instead of a VALUES
+ * list, the sqlite shipped for zmd does not know multi-row VALUES.
+ *
+ * Rows still buffered are written by flush(), callers must flush before
+ * anything reads or deletes dependencies on the same connection.
+*/
+
+class DbDependencyWriter
+{
+public:
+  /** sqlite allows 999 host parameters per statement, 10 (9 without name_id) are needed per row */
+  static const unsigned MAX_WIDTH = 99;
+  static const unsigned DEFAULT_WIDTH = 64;
+
+  /** Ctor */
+  DbDependencyWriter( unsigned width = DEFAULT_WIDTH );
+  /** Dtor */
+  ~DbDependencyWriter();
+
+  /** prepare statements for db, false on error
+   * table and owner_column select where rows go, e.g. dependency_set_rows/dep_set_id
+   * without with_name_id, table has no name_id column and rows must not be interned */
+  bool prepare( sqlite3 *db, const std::string & table = "dependencies", const std::string & owner_column = "resolvable_id", bool with_name_id = true );
+  /** flush and release statements */
+  void close( void );
+
+  /** rows per INSERT, takes effect for the next prepare() */
+  void setWidth( unsigned width );
+  unsigned width() const
+  { return _width; }
+
+  /** queue row, writes a batch if the buffer is full */
+  bool add( const DbDependencyRow & row );
+  /** write all queued rows */
+  bool flush( void );
+
+  /** number of rows actually written */
+  unsigned long written() const
+  { return _written; }
+
+private:
+  bool step( sqlite3_stmt *handle, std::vector<DbDependencyRow>::const_iterator begin, std::vector<DbDependencyRow>::const_iterator end );
+
+  sqlite3 *_db;
+  std::string _table;
+  bool _with_name_id;
+  sqlite3_stmt *_insert_dep_handle;		// single row
+  sqlite3_stmt *_insert_dep_batch_handle;	// _width rows
+  unsigned _width;
+  std::vector<DbDependencyRow> _rows;
+  unsigned long _written;
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBDEPENDENCYWRITER_H
@@ -0,0 +1,103 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbPackageDetails.cc
+ *
+*/
+
+#include <iostream>
+
+#include "zypp/base/Logger.h"
+#include "DbPackageDetails.h"
+#include "DbStatementCache.h"
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "DbPackageDetails"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+DbPackageDetails::DbPackageDetails( sqlite3 *db )
+    : _db( db )
+    , _fetches( 0 )
+{
+}
+
+
+DbPackageDetails::~DbPackageDetails()
+{
+  if (_fetches > 0)
+    MIL << _fetches << " package details fetched" << endl;
+}
+
+
+void
+DbPackageDetails::detach( void )
+{
+  _db = NULL;
+}
+
+
+bool
+DbPackageDetails::fetch( sqlite_int64 id, Details & details )
+{
+  if (_db == NULL)
+  {
+    ERR << "Package details of " << id << " requested after the database was closed" << endl;
+    return false;
+  }
+
+  sqlite3_stmt *handle = DbStatementCache::of( _db ).get(
+    //      0          1        2            3            4
+    "SELECT rpm_group, summary, description, package_url, package_filename "
+    "FROM packages WHERE id = ?" );
+  if (handle == NULL)
+  {
+    ERR << "Can not prepare package details selection clause: " << sqlite3_errmsg( _db ) << endl;
+    return false;
+  }
+
+  sqlite3_bind_int64( handle, 1, id );
+
+  bool result = false;
+  int rc = sqlite3_step( handle );
+  if (rc == SQLITE_ROW)
+  {
+    const char *text = (const char *) sqlite3_column_text( handle, 0 );
+    if (text != NULL)
+      details.group = text;
+    details.summary.read( handle, 1 );
+    details.description.read( handle, 2 );
+
+    text = (const char *) sqlite3_column_text( handle, 4 );	// package_filename
+    if (text == NULL
+        || *text == 0)
+    {
+      text = (const char *) sqlite3_column_text( handle, 3 );	// else use package_url
+    }
+    if (text == NULL)
+      ERR << "package_url NULL for id " << id << endl;
+    else
+      details.location = text;
+
+    ++_fetches;
+    result = true;
+  }
+  else if (rc == SQLITE_DONE)
+  {
+    ERR << "No package with id " << id << endl;
+  }
+  else
+  {
+    ERR << "Can not read package details of " << id << ": " << sqlite3_errmsg( _db ) << endl;
+  }
+
+  sqlite3_reset( handle );
+  return result;
+}
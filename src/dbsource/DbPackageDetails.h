@@ -0,0 +1,65 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbPackageDetails.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBPACKAGEDETAILS_H
+#define ZMD_BACKEND_DBSOURCE_DBPACKAGEDETAILS_H
+
+#include <string>
+
+#include <sqlite3.h>
+#include "zypp/base/ReferenceCounted.h"
+#include "zypp/base/NonCopyable.h"
+#include "zypp/base/PtrTypes.h"
+
+#include "DbPackedText.h"
+
+DEFINE_PTR_TYPE(DbPackageDetails);
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbPackageDetails
+//
+/** Reads the wide text columns of a package on demand
+ *
+ * Group, summary, description and location are not needed to solve,
+ * so packages are loaded without them and ask here on first access.
+ * One fetcher is bound to one connection and shared by all packages
+ * read from it. detach() it before the connection is closed, later
+ * fetches fail.
+*/
+
+class DbPackageDetails : public zypp::base::ReferenceCounted, public zypp::base::NonCopyable
+{
+public:
+  struct Details
+  {
+    std::string group;
+    DbPackedText summary;
+    DbPackedText description;
+    std::string location;		// package_filename if set, else package_url
+  };
+
+  DbPackageDetails( sqlite3 *db );
+  ~DbPackageDetails();
+
+  /** details of package id, false if it can not be read */
+  bool fetch( sqlite_int64 id, Details & details );
+
+  /** the connection is about to be closed */
+  void detach( void );
+
+private:
+  sqlite3 *_db;
+  unsigned _fetches;
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBPACKAGEDETAILS_H
@@ -34,58 +34,57 @@ namespace zypp
 */
 DbPackageImpl::DbPackageImpl (Source_Ref source_r)
     : _source (source_r)
+    , _details (NULL)
     , _install_only(false)
     , _size_installed(0)
     , _size_archive(0)
 {}
 
+DbPackageImpl::~DbPackageImpl()
+{
+  delete _details;
+}
+
 /**
  * read package specific data from handle
- * (see DbSourceImpl, create_package_handle(), the handle is for the package_details table)
+ * (see DbSourceImpl, create_package_handle(), the handle is for the packages view)
+ * group, summary, description and location are left to fetcher
  * throw() on error
  */
 
 void
-DbPackageImpl::readHandle( sqlite_int64 id, sqlite3_stmt *handle )
+DbPackageImpl::readHandle( sqlite_int64 id, sqlite3_stmt *handle, DbPackageDetails_Ptr fetcher )
 {
   _zmdid = id;
+  _fetcher = fetcher;
 
   // 1-5: nvra, see DbSourceImpl
   _size_installed = sqlite3_column_int( handle, 6 );
   // 7: catalog
   // 8: installed
   // 9: local
-  const char * text = ((const char *) sqlite3_column_text( handle, 10 ));
-  if (text != NULL)
-    _group = text;
-  _size_archive = sqlite3_column_int( handle, 11 );
-  text = (const char *) sqlite3_column_text( handle, 12 );
-  if (text != NULL)
-    _summary = TranslatedText( string( text ) );
-  text = (const char *) sqlite3_column_text( handle, 13 );
-  if (text != NULL)
-    _description = TranslatedText( string( text ) );
-  text = (const char *) sqlite3_column_text( handle, 15 );	// package_filename
-  if (text != NULL
-      && *text != 0)
-  {
-    _location = Pathname( text );				// if set, use this (zmd owned or local source)
-  }
-  else
-  {
-    text = (const char *)sqlite3_column_text( handle, 14 );	// else use package_url
-    if (text == NULL)
-      ERR << "package_url NULL for id " << id << endl;
-    else
-      _location = Pathname( text );
-  }
-  _install_only = (sqlite3_column_int( handle, 16 ) != 0);
-  _media_nr = sqlite3_column_int( handle, 17 );
+  _size_archive = sqlite3_column_int( handle, 10 );
+  _install_only = (sqlite3_column_int( handle, 11 ) != 0);
+  _media_nr = sqlite3_column_int( handle, 12 );
 
   return;
 }
 
 
+const DbPackageDetails::Details &
+DbPackageImpl::details() const
+{
+  if (_details == NULL)
+  {
+    _details = new DbPackageDetails::Details;
+    if (_fetcher)
+      _fetcher->fetch( _zmdid, *_details );
+    _fetcher = NULL;
+  }
+  return *_details;
+}
+
+
 Source_Ref
 DbPackageImpl::source() const
 {
@@ -95,23 +94,23 @@ DbPackageImpl::source() const
 /** Package summary */
 TranslatedText DbPackageImpl::summary() const
 {
-  return _summary;
+  return TranslatedText( details().summary.text() );
 }
 
 /** Package description */
 TranslatedText DbPackageImpl::description() const
 {
-  return _description;
+  return TranslatedText( details().description.text() );
 }
 
 PackageGroup DbPackageImpl::group() const
 {
-  return _group;
+  return details().group;
 }
 
 Pathname DbPackageImpl::location() const
 {
-  return _location;
+  return Pathname( details().location );
 }
 
 ByteCount DbPackageImpl::size() const
@@ -16,6 +16,8 @@
 #include "zypp/Source.h"
 #include <sqlite3.h>
 
+#include "DbPackageDetails.h"
+
 ///////////////////////////////////////////////////////////////////
 namespace zypp
 { /////////////////////////////////////////////////////////////////
@@ -33,7 +35,9 @@ public:
   /** Default ctor
   */
   DbPackageImpl( Source_Ref source_r );
-  void readHandle( sqlite_int64 id, sqlite3_stmt *handle );
+  ~DbPackageImpl();
+  /** read the solver relevant columns, the details come from fetcher on first access */
+  void readHandle( sqlite_int64 id, sqlite3_stmt *handle, DbPackageDetails_Ptr fetcher );
 
   /** Package summary */
   virtual TranslatedText summary() const;
@@ -64,11 +68,12 @@ public:
   void addPatchRpm( const zypp::packagedelta::PatchRpm &patch );
   
 protected:
+  /** the details, fetched on first call */
+  const DbPackageDetails::Details & details() const;
+
   Source_Ref _source;
-  TranslatedText _summary;
-  TranslatedText _description;
-  PackageGroup _group;
-  Pathname _location;
+  mutable DbPackageDetails_Ptr _fetcher;	// NULL once the details are read
+  mutable DbPackageDetails::Details *_details;
   bool _install_only;
   ZmdId _zmdid;
   unsigned _media_nr;
@@ -0,0 +1,126 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbPackedText.cc
+ *
+*/
+
+#include <zlib.h>
+
+#include "zypp/base/Logger.h"
+#include "DbPackedText.h"
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "DbPackedText"
+
+using namespace std;
+
+#define HEADER_SIZE 5		// codec, length
+
+//----------------------------------------------------------------------------
+
+bool
+text_pack( const string & text, string & blob )
+{
+  blob.clear();
+  if (text.size() < PACKED_TEXT_MIN_LENGTH)
+    return false;
+
+  uLongf size = compressBound( text.size() );
+  blob.resize( HEADER_SIZE + size );
+  if (compress2( (Bytef *) &blob[HEADER_SIZE], &size, (const Bytef *) text.data(), text.size(), Z_DEFAULT_COMPRESSION ) != Z_OK
+      || HEADER_SIZE + size >= text.size())
+  {
+    blob.clear();
+    return false;
+  }
+  blob.resize( HEADER_SIZE + size );
+
+  unsigned long length = text.size();
+  blob[0] = PACKED_TEXT_ZLIB;
+  for (int i = 1; i < HEADER_SIZE; ++i)
+  {
+    blob[i] = (char)(length & 0xff);
+    length >>= 8;
+  }
+  return true;
+}
+
+
+bool
+text_unpack( const void *blob, size_t size, string & text )
+{
+  text.clear();
+  const unsigned char *data = (const unsigned char *) blob;
+  if (data == NULL
+      || size < HEADER_SIZE
+      || data[0] != PACKED_TEXT_ZLIB)
+  {
+    return false;
+  }
+
+  uLongf length = 0;
+  for (int i = HEADER_SIZE - 1; i > 0; --i)
+    length = (length << 8) | data[i];
+  if (length / 1032 > size)		// more than zlib's best ratio, corrupt
+    return false;
+
+  text.resize( length );
+  uLongf unpacked = length;
+  if (uncompress( (Bytef *) (length > 0 ? &text[0] : NULL), &unpacked, data + HEADER_SIZE, size - HEADER_SIZE ) != Z_OK
+      || unpacked != length)
+  {
+    text.clear();
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+void
+DbPackedText::read( sqlite3_stmt *handle, int column )
+{
+  _packed = false;
+  _data.clear();
+
+  switch (sqlite3_column_type( handle, column ))
+  {
+    case SQLITE_NULL:
+      break;
+    case SQLITE_BLOB:
+    {
+      const char *blob = (const char *) sqlite3_column_blob( handle, column );
+      _data.assign( blob, sqlite3_column_bytes( handle, column ) );
+      _packed = true;
+      break;
+    }
+    default:
+    {
+      const char *text = (const char *) sqlite3_column_text( handle, column );
+      if (text != NULL)
+        _data = text;
+      break;
+    }
+  }
+}
+
+
+const string &
+DbPackedText::text() const
+{
+  if (_packed)
+  {
+    string text;
+    if (!text_unpack( _data.data(), _data.size(), text ))
+      ERR << "Can't unpack text of " << _data.size() << " bytes" << endl;
+    _data.swap( text );
+    _packed = false;
+  }
+  return _data;
+}
@@ -0,0 +1,66 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbPackedText.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBPACKEDTEXT_H
+#define ZMD_BACKEND_DBSOURCE_DBPACKEDTEXT_H
+
+#include <string>
+
+#include <sqlite3.h>
+
+//-----------------------------------------------------------------------------
+// long text columns (summary, description) stored compressed
+//
+// A packed text is written as BLOB, plain ones stay TEXT, so readers tell
+// them apart by the column type. Layout of the BLOB:
+//
+//   codec		PACKED_TEXT_ZLIB, one byte
+//   length		unpacked length, 4 bytes little endian
+//   data		zlib stream of the text
+
+#define PACKED_TEXT_ZLIB 1
+
+/** texts shorter than this are not worth packing */
+#define PACKED_TEXT_MIN_LENGTH 128
+
+/** pack text into blob, false (blob empty) if it is too short or does not shrink */
+bool text_pack( const std::string & text, std::string & blob );
+
+/** unpack blob into text, false (text empty) if it is malformed or of an unknown codec */
+bool text_unpack( const void *blob, size_t size, std::string & text );
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbPackedText
+//
+/** text column value as read, unpacked on first access
+*/
+
+class DbPackedText
+{
+public:
+  DbPackedText()
+      : _packed( false )
+  {}
+
+  /** take column of the current row of handle, TEXT or packed BLOB */
+  void read( sqlite3_stmt *handle, int column );
+
+  /** the text, empty for NULL */
+  const std::string & text() const;
+
+private:
+  mutable std::string _data;		// text, or blob while _packed
+  mutable bool _packed;
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBPACKEDTEXT_H
@@ -0,0 +1,117 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbRecordQueue.cc
+ *
+*/
+
+#include "DbRecordQueue.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+DbRecordQueue::DbRecordQueue( unsigned capacity )
+    : _capacity( capacity > 0 ? capacity : 1 )
+    , _finished( false )
+    , _cancelled( false )
+{
+  pthread_mutex_init( &_lock, NULL );
+  pthread_cond_init( &_not_empty, NULL );
+  pthread_cond_init( &_not_full, NULL );
+}
+
+
+DbRecordQueue::~DbRecordQueue()
+{
+  clear();
+  pthread_cond_destroy( &_not_full );
+  pthread_cond_destroy( &_not_empty );
+  pthread_mutex_destroy( &_lock );
+}
+
+
+// delete queued records, _lock held or no other thread left
+
+void
+DbRecordQueue::clear( void )
+{
+  for (deque<DbResRecord *>::iterator it = _records.begin(); it != _records.end(); ++it)
+    delete *it;
+  _records.clear();
+}
+
+
+bool
+DbRecordQueue::push( DbResRecord *record )
+{
+  pthread_mutex_lock( &_lock );
+  while (_records.size() >= _capacity
+         && !_cancelled)
+  {
+    pthread_cond_wait( &_not_full, &_lock );
+  }
+  bool result = !_cancelled;
+  if (result)
+  {
+    _records.push_back( record );
+    pthread_cond_signal( &_not_empty );
+  }
+  pthread_mutex_unlock( &_lock );
+
+  if (!result)
+    delete record;
+  return result;
+}
+
+
+void
+DbRecordQueue::finish( void )
+{
+  pthread_mutex_lock( &_lock );
+  _finished = true;
+  pthread_cond_signal( &_not_empty );
+  pthread_mutex_unlock( &_lock );
+}
+
+
+DbResRecord *
+DbRecordQueue::pop( void )
+{
+  DbResRecord *record = NULL;
+
+  pthread_mutex_lock( &_lock );
+  while (_records.empty()
+         && !_finished
+         && !_cancelled)
+  {
+    pthread_cond_wait( &_not_empty, &_lock );
+  }
+  if (!_records.empty()
+      && !_cancelled)
+  {
+    record = _records.front();
+    _records.pop_front();
+    pthread_cond_signal( &_not_full );
+  }
+  pthread_mutex_unlock( &_lock );
+
+  return record;
+}
+
+
+void
+DbRecordQueue::cancel( void )
+{
+  pthread_mutex_lock( &_lock );
+  _cancelled = true;
+  clear();
+  pthread_cond_broadcast( &_not_full );
+  pthread_cond_broadcast( &_not_empty );
+  pthread_mutex_unlock( &_lock );
+}
@@ -0,0 +1,71 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbRecordQueue.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBRECORDQUEUE_H
+#define ZMD_BACKEND_DBSOURCE_DBRECORDQUEUE_H
+
+#include <deque>
+
+#include <pthread.h>
+
+#include "DbResRecord.h"
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbRecordQueue
+//
+/** Bounded FIFO of DbResRecords between one producer and one consumer thread
+ *
+ * The producer push()es records and calls finish() when done, the consumer
+ * pop()s them in order until pop() returns NULL. A consumer giving up early
+ * calls cancel(), further push()es fail then. The queue owns the records
+ * it holds.
+*/
+
+class DbRecordQueue
+{
+public:
+  static const unsigned DEFAULT_CAPACITY = 64;
+
+  /** Ctor */
+  DbRecordQueue( unsigned capacity = DEFAULT_CAPACITY );
+  /** Dtor, deletes records not popped */
+  ~DbRecordQueue();
+
+  /** append record, blocks while the queue is full
+   * takes ownership, false (and record deleted) if cancelled */
+  bool push( DbResRecord *record );
+  /** no more records will be pushed */
+  void finish( void );
+
+  /** next record, blocks while the queue is empty
+   * caller owns the record, NULL if finished and empty or cancelled */
+  DbResRecord *pop( void );
+  /** stop the producer, drops all queued records */
+  void cancel( void );
+
+private:
+  DbRecordQueue( const DbRecordQueue & );
+  DbRecordQueue & operator=( const DbRecordQueue & );
+
+  void clear( void );
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _not_empty;
+  pthread_cond_t _not_full;
+  std::deque<DbResRecord *> _records;
+  unsigned _capacity;
+  bool _finished;
+  bool _cancelled;
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBRECORDQUEUE_H
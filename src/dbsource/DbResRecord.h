@@ -0,0 +1,132 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbResRecord.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBRESRECORD_H
+#define ZMD_BACKEND_DBSOURCE_DBRESRECORD_H
+
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "DbDependencyWriter.h"
+
+//-----------------------------------------------------------------------------
+// everything DbAccess writes for one ResObject, as plain values
+//
+// Filled from the zypp object by res_record() in DbAccess.cc and written
+// by DbAccess::writeRecord(), which only binds and steps. A record holds no
+// zypp objects, so it can be handed to another thread. Whatever went wrong
+// while filling it is kept in problems and logged by the writer.
+
+// patch_packages_baseversions row
+struct DbBaseVersionRecord
+{
+  std::string version;
+  std::string release;
+  int epoch;
+};
+
+// patch_packages row
+struct DbPatchRpmRecord
+{
+  int media_nr;
+  std::string location;
+  std::string checksum;			// type:checksum
+  int download_size;
+  int build_time;
+  std::vector<DbBaseVersionRecord> baseversions;
+};
+
+// delta_packages row
+struct DbDeltaRecord
+{
+  int media_nr;
+  std::string location;
+  std::string checksum;			// type:checksum
+  int download_size;
+  int build_time;
+  std::string base_version;
+  std::string base_release;
+  int base_epoch;
+  std::string base_checksum;		// type:checksum
+  int base_build_time;
+  std::string base_sequence_info;
+};
+
+struct DbResRecord
+{
+  enum Details { NO_DETAILS, PACKAGE, MESSAGE, SCRIPT, PATCH, PATTERN, PRODUCT, DETAILS_COUNT };
+
+  DbResRecord()
+      : epoch(0), arch(0), size(0), installed(false), local(false), status(0)
+      , have_category(false), have_license(false), kind(0), details(NO_DETAILS)
+      , have_url(false), have_filename(false), package_size(0), install_only(false), media_nr(0)
+      , timestamp(0), reboot_needed(false), affects_pkg_manager(false)
+      , summary_packed(false), description_packed(false)
+      , dep_set_hash(0), fingerprint(0)
+  {}
+
+  // resolvables
+  std::string name;
+  std::string version;
+  std::string release;
+  int epoch;
+  int arch;				// RCArch
+  sqlite_int64 size;
+  std::string catalog;
+  bool installed;
+  bool local;
+  int status;				// RCResolvableStatus
+  bool have_category;			// patches and products
+  std::string category;
+  bool have_license;			// if false, written as NULL
+  std::string license;
+  int kind;				// RCDependencyTarget
+
+  Details details;			// which _details table to write
+
+  // package_details, patch_details, pattern_details, product_details
+  std::string group;
+  std::string summary;
+  std::string description;
+  bool have_url;
+  std::string url;
+  bool have_filename;
+  std::string filename;
+  int package_size;
+  bool install_only;
+  int media_nr;
+  std::vector<DbDeltaRecord> deltas;
+  std::vector<DbPatchRpmRecord> patch_rpms;
+  bool summary_packed;			// summary/description hold a DbPackedText blob
+  bool description_packed;
+
+  // message_details (text) and script_details (text, undo_text)
+  std::string text;
+  std::string undo_text;
+
+  // patch_details
+  std::string patch_id;
+  sqlite_int64 timestamp;
+  bool reboot_needed;
+  bool affects_pkg_manager;
+
+  // dependencies, owner 0 and names inline, in deptable order
+  std::vector<DbDependencyRow> dependencies;
+  sqlite_int64 dep_set_hash;		// see DbAccess::depSetId()
+
+  sqlite_int64 fingerprint;		// see DbAccess::syncStore()
+
+  std::vector<std::string> problems;	// logged by DbAccess::writeRecord()
+};
+
+#endif // ZMD_BACKEND_DBSOURCE_DBRESRECORD_H
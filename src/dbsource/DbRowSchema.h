@@ -0,0 +1,130 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbRowSchema.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBROWSCHEMA_H
+#define ZMD_BACKEND_DBSOURCE_DBROWSCHEMA_H
+
+#include <string>
+
+#include <sqlite3.h>
+
+//-----------------------------------------------------------------------------
+// table rows written from plain structs
+//
+// A table is described once as a list of columns, each naming the struct
+// member it is bound from. The INSERT is generated from that list and
+// bind_row() binds the columns in list order, so statement and bind
+// indexes can not get out of step. The binders are instantiated per
+// member at compile time, binding a row is a loop over function pointers.
+
+template <class R>
+struct DbColumn
+{
+  typedef void (*Binder)( sqlite3_stmt *handle, int index, const R & row );
+
+  const char *name;			// NULL ends the list
+  Binder bind;
+};
+
+template <class R>
+struct DbRowSchema
+{
+  const char *table;
+  const char *owner_column;		// bound from the owner id as parameter 1, NULL if none
+  const DbColumn<R> *columns;
+};
+
+// binders
+
+template <class R, std::string R::*M>
+void bind_text( sqlite3_stmt *handle, int index, const R & row )
+{
+  sqlite3_bind_text( handle, index, (row.*M).c_str(), -1, SQLITE_STATIC );
+}
+
+// NULL unless row.*HAVE
+template <class R, std::string R::*M, bool R::*HAVE>
+void bind_optional_text( sqlite3_stmt *handle, int index, const R & row )
+{
+  sqlite3_bind_text( handle, index, (row.*HAVE) ? (row.*M).c_str() : NULL, -1, SQLITE_STATIC );
+}
+
+// BLOB if row.*PACKED (see DbPackedText.h)
+template <class R, std::string R::*M, bool R::*PACKED>
+void bind_packed_text( sqlite3_stmt *handle, int index, const R & row )
+{
+  if (row.*PACKED)
+    sqlite3_bind_blob( handle, index, (row.*M).data(), (row.*M).size(), SQLITE_STATIC );
+  else
+    sqlite3_bind_text( handle, index, (row.*M).c_str(), -1, SQLITE_STATIC );
+}
+
+template <class R, int R::*M>
+void bind_int( sqlite3_stmt *handle, int index, const R & row )
+{
+  sqlite3_bind_int( handle, index, row.*M );
+}
+
+template <class R, sqlite_int64 R::*M>
+void bind_int64( sqlite3_stmt *handle, int index, const R & row )
+{
+  sqlite3_bind_int64( handle, index, row.*M );
+}
+
+template <class R, bool R::*M>
+void bind_bool( sqlite3_stmt *handle, int index, const R & row )
+{
+  sqlite3_bind_int( handle, index, (row.*M) ? 1 : 0 );
+}
+
+template <class R>
+void bind_null( sqlite3_stmt *handle, int index, const R & row )
+{
+  sqlite3_bind_null( handle, index );
+}
+
+// "INSERT INTO table (owner, columns...) VALUES (?, ...)"
+
+template <class R>
+std::string row_insert( const DbRowSchema<R> & schema )
+{
+  std::string columns, values;
+  if (schema.owner_column != NULL)
+  {
+    columns = schema.owner_column;
+    values = "?";
+  }
+  for (const DbColumn<R> *column = schema.columns; column->name != NULL; ++column)
+  {
+    if (!columns.empty())
+    {
+      columns += ", ";
+      values += ", ";
+    }
+    columns += column->name;
+    values += "?";
+  }
+  return "INSERT INTO " + std::string( schema.table ) + " (" + columns + ") VALUES (" + values + ")";
+}
+
+// bind row (and owner) to handle, prepared from row_insert( schema )
+
+template <class R>
+void bind_row( sqlite3_stmt *handle, const DbRowSchema<R> & schema, sqlite_int64 owner, const R & row )
+{
+  int index = 1;
+  if (schema.owner_column != NULL)
+    sqlite3_bind_int64( handle, index++, owner );
+  for (const DbColumn<R> *column = schema.columns; column->name != NULL; ++column)
+    column->bind( handle, index++, row );
+}
+
+#endif // ZMD_BACKEND_DBSOURCE_DBROWSCHEMA_H
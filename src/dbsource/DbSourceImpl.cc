@@ -20,6 +20,9 @@
  */
 
 #include "DbSourceImpl.h"
+#include "DbDependencyBlob.h"
+#include "DbStatementCache.h"
+#include "DbCapabilityCache.h"
 
 #include "DbPackageImpl.h"
 #include "DbAtomImpl.h"
@@ -33,29 +36,60 @@
 #include "zypp/source/SourceImpl.h"
 #include "zypp/base/Logger.h"
 #include "zypp/base/Exception.h"
+#include "zypp/base/String.h"
 #include "zypp/CapFactory.h"
 
+#include <cstring>
+#include <list>
+#include <map>
+
+#include <sys/time.h>
+
 using namespace std;
 using namespace zypp;
 
-static CheckSum encoded_string_to_checksum( const std::string &encoded )
+typedef map<sqlite_int64, list<packagedelta::DeltaRpm> > DeltaRpmMap;
+typedef map<sqlite_int64, list<packagedelta::PatchRpm> > PatchRpmMap;
+
+// "type:checksum" as written by DbAccess, empty CheckSum if malformed
+
+static CheckSum encoded_string_to_checksum( const char *encoded )
 {
-  vector<string> words;
-  if ( str::split( encoded, std::back_inserter(words), ":" ) != 2 )
-  {
+  if (encoded == NULL)
     return CheckSum();
-  }
-  else
+  const char *colon = strchr( encoded, ':' );
+  if (colon == NULL
+      || colon == encoded
+      || colon[1] == '\0'
+      || strchr( colon + 1, ':' ) != NULL)
   {
-    return CheckSum( words[0], words[1] );
+    return CheckSum();
   }
+  return CheckSum( string( encoded, colon - encoded ), string( colon + 1 ) );
 }
 
 //---------------------------------------------------------------------------
 
 DbSourceImpl::DbSourceImpl( DbSourceImplPolicy policy )
     : _db (NULL)
+    , _dependency_handle (NULL)
+    , _dep_name_handle (NULL)
+    , _have_dep_name_ids (false)
+    , _res_dep_set_handle (NULL)
+    , _dep_set_handle (NULL)
+    , _have_dep_sets (false)
+    , _dep_blob_handle (NULL)
+    , _have_dep_blobs (false)
+    , _dep_scan_handle (NULL)
+    , _dep_scan_rc (SQLITE_DONE)
+    , _dep_scan_id_column (0)
+    , _dep_scan_rows (0)
+    , _shard_db (NULL)
+    , _id_offset (0)
     , _idmap (NULL)
+    , _cap_cache (NULL)
+    , _loader_job (0)
+    , _have_loaded_rows (false)
     , _policy(policy)
 {}
 
@@ -63,6 +97,18 @@ DbSourceImpl::DbSourceImpl( DbSourceImplPolicy policy )
 DbSourceImpl::~DbSourceImpl()
 {
   sqlite3_finalize( _dependency_handle);
+  sqlite3_finalize( _dep_name_handle);
+  sqlite3_finalize( _res_dep_set_handle);
+  sqlite3_finalize( _dep_set_handle);
+  sqlite3_finalize( _dep_blob_handle);
+  endDependencyScan();
+  if (_shard_db)
+  {
+    if (_package_details)
+      _package_details->detach();
+    DbStatementCache::release( _shard_db );
+    sqlite3_close( _shard_db);
+  }
 }
 
 void
@@ -100,6 +146,38 @@ DbSourceImpl::attachDatabase( sqlite3 *db)
   _db = db;
 }
 
+void
+DbSourceImpl::attachShard( const std::string & file, sqlite_int64 id_offset )
+{
+  _shard_file = file;
+  _id_offset = id_offset;
+}
+
+void
+DbSourceImpl::attachContent( const std::string & content )
+{
+  _content = content;
+}
+
+void
+DbSourceImpl::attachCapabilityCache( DbCapabilityCache *cache )
+{
+  _cap_cache = cache;
+}
+
+void
+DbSourceImpl::attachPackageDetails( DbPackageDetails_Ptr fetcher )
+{
+  _package_details = fetcher;
+}
+
+void
+DbSourceImpl::attachLoader( zypp::shared_ptr<DbCatalogLoader> loader, unsigned job )
+{
+  _loader = loader;
+  _loader_job = job;
+}
+
 void
 DbSourceImpl::attachIdMap (IdMap *idmap)
 {
@@ -130,20 +208,23 @@ create_select_handle( sqlite3 *db, const char *query )
   return handle;
 }
 
+// dependencies of one owner from table (dependencies or dependency_set_rows)
+
 static sqlite3_stmt *
-create_dependency_handle (sqlite3 *db)
+create_dependency_handle (sqlite3 *db, bool with_name_id, const string & table = "dependencies", const string & owner_column = "resolvable_id")
 {
-  const char *query;
+  string query;
   int rc;
   sqlite3_stmt *handle = NULL;
 
   query =
     //	      0         1     2        3        4      5     6         7
-    "SELECT dep_type, name, version, release, epoch, arch, relation, dep_target "
-    "FROM dependencies "
-    "WHERE resolvable_id = ?";
+    "SELECT dep_type, name, version, release, epoch, arch, relation, dep_target";
+  if (with_name_id)
+    query += ", name_id";	// 8
+  query += " FROM " + table + " WHERE " + owner_column + " = ?";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
+  rc = sqlite3_prepare ( db, query.c_str(), -1, &handle, NULL);
   if (rc != SQLITE_OK)
   {
     ERR << "Can not prepare dependency selection clause: " << sqlite3_errmsg ( db) << endl;
@@ -155,11 +236,75 @@ create_dependency_handle (sqlite3 *db)
 }
 
 
+// true if table exists and is not empty
+
+static bool
+table_has_rows( sqlite3 *db, const string & table )
+{
+  string query( "SELECT 1 FROM " + table + " LIMIT 1" );
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare ( db, query.c_str(), -1, &handle, NULL) != SQLITE_OK)
+  {
+    sqlite3_finalize (handle);
+    return false;		// no such table
+  }
+  bool result = (sqlite3_step( handle) == SQLITE_ROW);
+  sqlite3_finalize (handle);
+  return result;
+}
+
+
+// milliseconds since start
+
+static long
+elapsed_ms( const struct timeval & start )
+{
+  struct timeval now;
+  gettimeofday( &now, NULL );
+  return (now.tv_sec - start.tv_sec) * 1000L + (now.tv_usec - start.tv_usec) / 1000L;
+}
+
+
+// condition selecting the resolvables of catalog, "catalog = ?"
+//  If the backend recorded a dense id range for the catalog (see
+//  DbAccess::updateCatalogRange()) and nothing was written since, the
+//  rows are read by a range scan on the primary key instead, catalog
+//  stays parameter 1 either way.
+
+static string
+catalog_condition( sqlite3 *db, const string & catalog )
+{
+  string where( "catalog = ?" );
+  if (!DbAccess::catalogRangesValid( db ))
+    return where;
+
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare ( db, "SELECT first_id, last_id, count FROM catalog_ranges WHERE catalog = ?", -1, &handle, NULL) != SQLITE_OK)
+  {
+    sqlite3_finalize (handle);
+    return where;		// db not written by this backend yet
+  }
+  sqlite3_bind_text (handle, 1, catalog.c_str(), -1, SQLITE_STATIC);
+  if (sqlite3_step( handle) == SQLITE_ROW)
+  {
+    sqlite_int64 first = sqlite3_column_int64( handle, 0 );
+    sqlite_int64 last = sqlite3_column_int64( handle, 1 );
+    sqlite_int64 count = sqlite3_column_int64( handle, 2 );
+    if (count > 0
+        && count * 2 >= last - first + 1)		// at least half of the range is ours
+    {
+      where = "+catalog = ? AND id BETWEEN " + str::numstring( first ) + " AND " + str::numstring( last );
+    }
+  }
+  sqlite3_finalize (handle);
+  return where;
+}
+
+
 static sqlite3_stmt *
-create_resolvables_handle (sqlite3 *db)
+create_resolvables_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -168,13 +313,12 @@ create_resolvables_handle (sqlite3 *db)
     //      6               7        8          9      10
     "       installed_size, catalog, installed, local, kind "
     "FROM resolvables "
-    "WHERE catalog = ? AND kind = ?";
+    "WHERE " + where + " AND kind = ?" + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare resolvables selection clause: " << sqlite3_errmsg ( db) << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
@@ -183,10 +327,9 @@ create_resolvables_handle (sqlite3 *db)
 
 
 static sqlite3_stmt *
-create_message_handle (sqlite3 *db)
+create_message_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -197,61 +340,155 @@ create_message_handle (sqlite3 *db)
     //      8          9      10
     "       installed, local, content "
     "FROM messages "
-    "WHERE catalog = ?";
+    "WHERE " + where + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare messages selection clause: " << sqlite3_errmsg ( db) << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
   return handle;
 }
 
+//-----------------------------------------------------------------------------
+// delta and patch rpms of all packages of a catalog
+//
+// Read up front in one scan per table, keyed by package_id, instead of
+// querying them for each package.
+
+// prepare query, bind catalog as parameter 1
+
 static sqlite3_stmt *
-create_patch_package_handle(sqlite3 *db)
+create_catalog_scan( sqlite3 *db, const string & query, const string & catalog )
 {
-  const char *query;
-  query =
-    //     0       1          2         3        4            5
-    "SELECT id, media_nr, location, checksum, download_size, build_time "
-    "FROM patch_packages WHERE package_id = ?";
-
-  return create_select_handle( db, query );
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare ( db, query.c_str(), -1, &handle, NULL) != SQLITE_OK)
+  {
+    ERR << "Can not prepare '" << query << "': " << sqlite3_errmsg ( db) << endl;
+    sqlite3_finalize (handle);
+    return NULL;
+  }
+  sqlite3_bind_text (handle, 1, catalog.c_str(), -1, SQLITE_STATIC);
+  return handle;
 }
 
-static sqlite3_stmt *
-create_patch_package_baseversion_handle(sqlite3 *db)
+
+static void
+read_delta_rpms( sqlite3 *db, const string & where, const string & catalog, DeltaRpmMap & deltas )
 {
-  const char *query;
-  query =
-    "SELECT version, release, epoch "
-    "FROM patch_packages_baseversions WHERE patch_package_id = ?";
+  string query(
+    //      0           1         2         3         4              5           6                    7                    8                  9                     10
+    "SELECT package_id, media_nr, location, checksum, download_size, build_time, baseversion_version, baseversion_release, baseversion_epoch, baseversion_checksum, baseversion_build_time, "
+    //      11
+    "       baseversion_sequence_info "
+    "FROM delta_packages WHERE package_id IN (SELECT id FROM packages WHERE " + where + ")" );
+
+  sqlite3_stmt *handle = create_catalog_scan( db, query, catalog );
+  if (handle == NULL)
+    return;
 
-  return create_select_handle( db, query );
+  while (sqlite3_step (handle) == SQLITE_ROW)
+  {
+    CheckSum checksum = encoded_string_to_checksum( (const char *) sqlite3_column_text( handle, 3 ) );
+    CheckSum base_checksum = encoded_string_to_checksum( (const char *) sqlite3_column_text( handle, 9 ) );
+    if ( checksum.empty() || base_checksum.empty() )
+    {
+      ERR << "Wrong checksum for delta, skipping..." << endl;
+      continue;
+    }
+
+    zypp::OnMediaLocation on_media;
+    on_media.medianr( sqlite3_column_int( handle, 1 ) );
+    on_media.filename( Pathname((const char *) sqlite3_column_text( handle, 2 )) );
+    on_media.checksum( checksum );
+    on_media.downloadsize( sqlite3_column_int( handle, 4 ) );
+
+    packagedelta::DeltaRpm::BaseVersion baseversion;
+    baseversion.edition( Edition( (const char *) sqlite3_column_text( handle, 6 ), (const char *) sqlite3_column_text( handle, 7 ), sqlite3_column_int( handle, 8 ) ) );
+    baseversion.checksum( base_checksum );
+    baseversion.buildtime( sqlite3_column_int( handle, 10 ) );
+    baseversion.sequenceinfo( (const char *) sqlite3_column_text( handle, 11 ) );
+
+    zypp::packagedelta::DeltaRpm delta;
+    delta.location( on_media );
+    delta.baseversion( baseversion );
+    delta.buildtime( sqlite3_column_int( handle, 5 ) );
+
+    deltas[sqlite3_column_int64( handle, 0 )].push_back( delta );
+  }
+  sqlite3_finalize (handle);
 }
 
-static sqlite3_stmt *
-create_delta_package_handle(sqlite3 *db)
+
+static void
+read_patch_rpms( sqlite3 *db, const string & where, const string & catalog, PatchRpmMap & patches )
 {
-  const char *query;
+  string packages( "SELECT id FROM packages WHERE " + where );
+
+  // base versions first, by patch_packages.id
+
+  map<sqlite_int64, vector<packagedelta::PatchRpm::BaseVersion> > baseversions;
+  string query(
+    //      0                 1        2        3
+    "SELECT patch_package_id, version, release, epoch "
+    "FROM patch_packages_baseversions WHERE patch_package_id IN"
+    " (SELECT id FROM patch_packages WHERE package_id IN (" + packages + "))" );
+
+  sqlite3_stmt *handle = create_catalog_scan( db, query, catalog );
+  if (handle == NULL)
+    return;
+  while (sqlite3_step (handle) == SQLITE_ROW)
+  {
+    baseversions[sqlite3_column_int64( handle, 0 )].push_back(
+      packagedelta::PatchRpm::BaseVersion( (const char *) sqlite3_column_text( handle, 1 ), (const char *) sqlite3_column_text( handle, 2 ), sqlite3_column_int( handle, 3 ) ) );
+  }
+  sqlite3_finalize (handle);
+
   query =
-    //       0     1      2          3        4         5              6                      7                      8                 9                     10
-    "SELECT id, media_nr, location, checksum, download_size, build_time,  baseversion_version, baseversion_release, baseversion_epoch, baseversion_checksum, baseversion_build_time "
-    //    11
-    ", baseversion_sequence_info "
-    "FROM delta_packages WHERE package_id = ?";
+    //      0   1           2         3         4         5              6
+    "SELECT id, package_id, media_nr, location, checksum, download_size, build_time "
+    "FROM patch_packages WHERE package_id IN (" + packages + ")";
+
+  handle = create_catalog_scan( db, query, catalog );
+  if (handle == NULL)
+    return;
+  while (sqlite3_step (handle) == SQLITE_ROW)
+  {
+    CheckSum checksum = encoded_string_to_checksum( (const char *) sqlite3_column_text( handle, 4 ) );
+    if ( checksum.empty() )
+    {
+      ERR << "Wrong checksum for delta, skipping..." << endl;
+      continue;
+    }
+
+    zypp::OnMediaLocation on_media;
+    on_media.medianr( sqlite3_column_int( handle, 2 ) );
+    on_media.filename( Pathname((const char *) sqlite3_column_text( handle, 3 )) );
+    on_media.checksum( checksum );
+    on_media.downloadsize( sqlite3_column_int( handle, 5 ) );
+
+    zypp::packagedelta::PatchRpm patch;
+    patch.location( on_media );
+    patch.buildtime( sqlite3_column_int( handle, 6 ) );
+
+    map<sqlite_int64, vector<packagedelta::PatchRpm::BaseVersion> >::const_iterator it = baseversions.find( sqlite3_column_int64( handle, 0 ) );
+    if (it != baseversions.end())
+    {
+      for (vector<packagedelta::PatchRpm::BaseVersion>::const_iterator bv = it->second.begin(); bv != it->second.end(); ++bv)
+        patch.baseversion( *bv );
+    }
 
-  return create_select_handle( db, query );
+    patches[sqlite3_column_int64( handle, 1 )].push_back( patch );
+  }
+  sqlite3_finalize (handle);
 }
 
 static sqlite3_stmt *
-create_script_handle (sqlite3 *db)
+create_script_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -262,13 +499,12 @@ create_script_handle (sqlite3 *db)
     //      8          9      10	     11
     "       installed, local, do_script, undo_script "
     "FROM scripts "
-    "WHERE catalog = ?";
+    "WHERE " + where + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare scripts selection clause: " << sqlite3_errmsg ( db) << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
@@ -277,10 +513,9 @@ create_script_handle (sqlite3 *db)
 
 
 static sqlite3_stmt *
-create_package_handle (sqlite3 *db)
+create_package_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -288,20 +523,17 @@ create_package_handle (sqlite3 *db)
     "SELECT id, name, version, release, epoch, arch, "
     //      6               7
     "       installed_size, catalog,"
-    //      8          9      10         11
-    "       installed, local, rpm_group, file_size,"
-    //      12       13           14           15
-    "       summary, description, package_url, package_filename,"
-    //      16            17
+    //      8          9      10
+    "       installed, local, file_size,"
+    //      11            12
     "       install_only, media_nr "
     "FROM packages "
-    "WHERE catalog = ?";
+    "WHERE " + where + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare packages selection clause: " << sqlite3_errmsg ( db) << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
@@ -310,10 +542,9 @@ create_package_handle (sqlite3 *db)
 
 
 static sqlite3_stmt *
-create_patch_handle (sqlite3 *db)
+create_patch_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -328,14 +559,13 @@ create_patch_handle (sqlite3 *db)
     //      15       16
     "       restart, interactive "
     "FROM patches "
-    "WHERE catalog = ?";
+    "WHERE " + where + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare patches selection clause: " << sqlite3_errmsg ( db) << endl;
     ERR << "Clause: [" << query << "]" << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
@@ -344,10 +574,9 @@ create_patch_handle (sqlite3 *db)
 
 
 static sqlite3_stmt *
-create_pattern_handle (sqlite3 *db)
+create_pattern_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -358,14 +587,13 @@ create_pattern_handle (sqlite3 *db)
     //      8          9      10
     "       installed, local, status "
     "FROM patterns "
-    "WHERE catalog = ?";
+    "WHERE " + where + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare patterns selection clause: " << sqlite3_errmsg ( db) << endl;
     ERR << "Clause: [" << query << "]" << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
@@ -374,10 +602,9 @@ create_pattern_handle (sqlite3 *db)
 
 
 static sqlite3_stmt *
-create_product_handle (sqlite3 *db)
+create_product_handle (sqlite3 *db, const string & where)
 {
-  const char *query;
-  int rc;
+  string query;
   sqlite3_stmt *handle = NULL;
 
   query =
@@ -388,14 +615,13 @@ create_product_handle (sqlite3 *db)
     //      8          9      10      11
     "       installed, local, status, category "
     "FROM products "
-    "WHERE catalog = ?";
+    "WHERE " + where + " ORDER BY id";
 
-  rc = sqlite3_prepare ( db, query, -1, &handle, NULL);
-  if (rc != SQLITE_OK)
+  handle = DbStatementCache::of( db ).get( query );
+  if (handle == NULL)
   {
     ERR << "Can not prepare products selection clause: " << sqlite3_errmsg ( db) << endl;
     ERR << "Clause: [" << query << "]" << endl;
-    sqlite3_finalize (handle);
     return NULL;
   }
 
@@ -410,15 +636,86 @@ DbSourceImpl::createResolvables(Source_Ref source_r)
 {
   MIL << "DbSourceImpl::createResolvables(" << source_r.id() << ")" << endl;
   _source = source_r;
+
+  struct timeval start;
+  gettimeofday( &start, NULL );
+
+  // sharded catalog, read from its own db file (opened on first use)
+  if (!_shard_file.empty()
+      && _shard_db == NULL)
+  {
+    if (sqlite3_open( _shard_file.c_str(), &_shard_db ) != SQLITE_OK)
+    {
+      ERR << "Can't open shard " << _shard_file << ": " << sqlite3_errmsg( _shard_db ) << endl;
+      sqlite3_close( _shard_db );
+      _shard_db = NULL;
+      return;
+    }
+    MIL << "Reading catalog " << source_r.id() << " from " << _shard_file << endl;
+    _db = _shard_db;
+    _package_details = new DbPackageDetails( _shard_db );
+  }
+
   if ( _db == NULL)
   {
     ERR << "Must call attachDatabase() first" << endl;
     return;
   }
 
-  _dependency_handle = create_dependency_handle ( _db);
+  if (_content.empty())
+    _content = source_r.id();
+  else
+    MIL << "Catalog " << source_r.id() << " shares the resolvables of " << _content << endl;
+
+  _catalog_where = catalog_condition( _db, _content );
+  DBG << "Catalog " << source_r.id() << ": " << _catalog_where << endl;
+
+  // dependencies.name_id is only present if the backend ever wrote to this db
+  _have_dep_name_ids = DbAccess::haveColumn( _db, "dependencies", "name_id" );
+  _dependency_handle = create_dependency_handle ( _db, _have_dep_name_ids);
   if ( _dependency_handle == NULL) return;
+  if (_have_dep_name_ids)
+  {
+    _dep_name_handle = create_select_handle( _db, "SELECT name FROM dep_names WHERE id = ?" );
+    if ( _dep_name_handle == NULL) return;
+  }
+
+  // shared dependency sets, only if any resolvable uses one
+  _have_dep_sets = table_has_rows( _db, "resolvable_dep_sets" );
+  if (_have_dep_sets)
+  {
+    _res_dep_set_handle = create_select_handle( _db, "SELECT dep_set_id FROM resolvable_dep_sets WHERE resolvable_id = ?" );
+    if ( _res_dep_set_handle == NULL) return;
+    _dep_set_handle = create_dependency_handle( _db, true, "dependency_set_rows", "dep_set_id" );
+    if ( _dep_set_handle == NULL) return;
+  }
+
+  // packed dependencies, only if any resolvable has a blob
+  _have_dep_blobs = table_has_rows( _db, "resolvable_dep_blobs" );
+  if (_have_dep_blobs)
+  {
+    _dep_blob_handle = create_select_handle( _db, "SELECT deps FROM resolvable_dep_blobs WHERE resolvable_id = ?" );
+    if ( _dep_blob_handle == NULL) return;
+  }
 
+  // file provides kept apart, see DbAccess::setSplitFileProvides()
+  _file_provides.clear();
+  if (table_has_rows( _db, "file_provides" ))
+    readFileProvides();
+
+  // dependency rows read ahead by a loader thread, see DbSources::sources()
+  if (_loader)
+  {
+    string error;
+    _have_loaded_rows = _loader->take( _loader_job, _loaded_rows, error );
+    if (_have_loaded_rows)
+      DBG << "Catalog " << source_r.id() << ": dependencies of " << _loaded_rows.size() << " resolvables read ahead" << endl;
+    else if (!error.empty())
+      ERR << "Catalog " << source_r.id() << ": dependencies not read ahead, " << error << endl;
+    _loader.reset();		// the last one stops the threads
+  }
+
+  _dep_scan_rows = 0;
   createPackages();
   createAtoms();
   createMessages();
@@ -428,6 +725,15 @@ DbSourceImpl::createResolvables(Source_Ref source_r)
   createPatterns();
   createProducts();
 
+  _loaded_rows.clear();
+  _have_loaded_rows = false;
+
+  MIL << "Catalog " << source_r.id() << ": " << _store.size() << " resolvables, "
+      << _dep_scan_rows << " dependencies scanned in " << elapsed_ms( start ) << " ms" << endl;
+  if (_cap_cache != NULL)
+    MIL << "Capability cache: " << _cap_cache->hits() << " hits, " << _cap_cache->misses() << " misses so far ("
+        << _cap_cache->hitRate() << "% hit rate)" << endl;
+
   return;
 }
 
@@ -435,12 +741,14 @@ DbSourceImpl::createResolvables(Source_Ref source_r)
 void
 DbSourceImpl::createAtoms(void)
 {
-  sqlite3_stmt *handle = create_resolvables_handle( _db );
+  sqlite3_stmt *handle = create_resolvables_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text (handle, 1, _source.id().c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text (handle, 1, _content.c_str(), -1, SQLITE_STATIC);
   sqlite3_bind_int (handle, 2, RC_DEP_TARGET_ATOM);
 
+  beginDependencyScan( "resolvables", RC_DEP_TARGET_ATOM );
+
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
   {
@@ -468,17 +776,19 @@ DbSourceImpl::createAtoms(void)
       _store.insert( atom );
       XXX << "Atom[" << id << "] " << *atom << endl;
       if ( _idmap != 0)
-        (*_idmap)[id] = atom;
+        (*_idmap)[id + _id_offset] = atom;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create atom object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -486,10 +796,12 @@ DbSourceImpl::createAtoms(void)
 void
 DbSourceImpl::createMessages(void)
 {
-  sqlite3_stmt *handle = create_message_handle( _db );
+  sqlite3_stmt *handle = create_message_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text( handle, 1, _source.id().c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 1, _content.c_str(), -1, SQLITE_STATIC );
+
+  beginDependencyScan( "messages" );
 
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -520,17 +832,19 @@ DbSourceImpl::createMessages(void)
       _store.insert( message );
       XXX << "Message[" << id << "] " << *message << endl;
       if (_idmap != 0)
-        (*_idmap)[id] = message;
+        (*_idmap)[id + _id_offset] = message;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create message object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -538,10 +852,12 @@ DbSourceImpl::createMessages(void)
 void
 DbSourceImpl::createScripts(void)
 {
-  sqlite3_stmt *handle = create_script_handle( _db );
+  sqlite3_stmt *handle = create_script_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text( handle, 1, _source.id().c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 1, _content.c_str(), -1, SQLITE_STATIC );
+
+  beginDependencyScan( "scripts" );
 
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -576,17 +892,19 @@ DbSourceImpl::createScripts(void)
       _store.insert( script );
       XXX << "Script[" << id << "] " << *script << endl;
       if ( _idmap != 0)
-        (*_idmap)[id] = script;
+        (*_idmap)[id + _id_offset] = script;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create script object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -594,12 +912,14 @@ DbSourceImpl::createScripts(void)
 void
 DbSourceImpl::createLanguages(void)
 {
-  sqlite3_stmt *handle = create_resolvables_handle( _db );
+  sqlite3_stmt *handle = create_resolvables_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text (handle, 1, _source.id().c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text (handle, 1, _content.c_str(), -1, SQLITE_STATIC);
   sqlite3_bind_int (handle, 2, RC_DEP_TARGET_LANGUAGE);
 
+  beginDependencyScan( "resolvables", RC_DEP_TARGET_LANGUAGE );
+
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
   {
@@ -627,17 +947,19 @@ DbSourceImpl::createLanguages(void)
       _store.insert( language );
       XXX << "Language[" << id << "] " << *language << endl;
       if ( _idmap != 0)
-        (*_idmap)[id] = language;
+        (*_idmap)[id + _id_offset] = language;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create language object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -645,19 +967,21 @@ DbSourceImpl::createLanguages(void)
 void
 DbSourceImpl::createPackages(void)
 {
-  sqlite3_stmt *handle = create_package_handle ( _db);
+  sqlite3_stmt *handle = create_package_handle( _db, _catalog_where );
   if (handle == NULL) return;
   
-  sqlite3_stmt *delta_handle = create_delta_package_handle ( _db);
-  if (delta_handle == NULL) return;
+  // delta and patch rpms, only if the db has any at all
+  DeltaRpmMap deltas;
+  if (table_has_rows( _db, "delta_packages" ))
+    read_delta_rpms( _db, _catalog_where, _content, deltas );
+  PatchRpmMap patches;
+  if (table_has_rows( _db, "patch_packages" ))
+    read_patch_rpms( _db, _catalog_where, _content, patches );
+  DBG << "Catalog " << _source.id() << ": delta rpms for " << deltas.size() << ", patch rpms for " << patches.size() << " packages" << endl;
 
-  sqlite3_stmt *patch_handle = create_patch_package_handle( _db );
-  if ( patch_handle == NULL ) return;
-  
-  sqlite3_stmt *baseversion_handle = create_patch_package_baseversion_handle( _db );
-  if ( baseversion_handle == NULL ) return;
-  
-  sqlite3_bind_text (handle, 1, _source.id().c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text (handle, 1, _content.c_str(), -1, SQLITE_STATIC);
+
+  beginDependencyScan( "packages" );
 
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -676,88 +1000,22 @@ DbSourceImpl::createPackages(void)
       unsigned epoch = sqlite3_column_int( handle, 4 );
       Arch arch( DbAccess::Rc2Arch( (RCArch)(sqlite3_column_int( handle, 5 )) ) );
 
-      impl->readHandle( id, handle );
+      impl->readHandle( id, handle, _package_details );
       
-      // delta rpms
-      int delta_rc;
-      // bind the master package id to the query
-      sqlite3_bind_int64 (delta_handle, 1, id );
-      while ((delta_rc = sqlite3_step (delta_handle)) == SQLITE_ROW)
+      // delta and patch rpms
+      DeltaRpmMap::const_iterator delta_it = deltas.find( id );
+      if (delta_it != deltas.end())
       {
-        zypp::OnMediaLocation on_media;
-        on_media.medianr( sqlite3_column_int( delta_handle, 1 ) );
-        on_media.filename( Pathname((const char *) sqlite3_column_text( delta_handle, 2 )) );
-        
-        string checksum_string( (const char *) sqlite3_column_text( delta_handle, 3 ) );
-        CheckSum checksum = encoded_string_to_checksum(checksum_string);
-        if ( checksum.empty() )
-        {
-          ERR << "Wrong checksum for delta, skipping..." << endl;
-          continue;
-        }
-        on_media.checksum(checksum);
-        on_media.downloadsize(sqlite3_column_int( delta_handle, 4 ));
-        
-        packagedelta::DeltaRpm::BaseVersion baseversion;
-        baseversion.edition( Edition( (const char *) sqlite3_column_text( delta_handle, 6 ) , (const char *) sqlite3_column_text( delta_handle, 7 ), sqlite3_column_int( delta_handle, 8 ) ));
-        
-        checksum_string = (const char *) sqlite3_column_text( delta_handle, 9 );
-        checksum = encoded_string_to_checksum(checksum_string);
-        if ( checksum.empty() )
-        {
-          ERR << "Wrong checksum for delta, skipping..." << endl;
-          continue;
-        }
-        baseversion.checksum(checksum);
-        baseversion.buildtime( sqlite3_column_int( delta_handle, 10 ) );
-        baseversion.sequenceinfo( (const char *) sqlite3_column_text( delta_handle, 11 ) );
-         
-        zypp::packagedelta::DeltaRpm delta;
-        delta.location( on_media );
-        delta.baseversion( baseversion );
-        delta.buildtime( sqlite3_column_int( delta_handle, 5 ) );
-        
-        impl->addDeltaRpm(delta);
+        for (list<packagedelta::DeltaRpm>::const_iterator it = delta_it->second.begin(); it != delta_it->second.end(); ++it)
+          impl->addDeltaRpm( *it );
       }
-      
-      // patch rpms
-      int patch_rc;
-      // bind the master package id to the query
-      sqlite3_bind_int64(patch_handle, 1, id );
-      while ((patch_rc = sqlite3_step (patch_handle)) == SQLITE_ROW)
+      PatchRpmMap::const_iterator patch_it = patches.find( id );
+      if (patch_it != patches.end())
       {
-        sqlite_int64 patch_package_id = sqlite3_column_int64( patch_handle, 0 );
-        
-        zypp::OnMediaLocation on_media;
-        on_media.medianr( sqlite3_column_int( patch_handle, 1 ) );
-        on_media.filename( Pathname((const char *) sqlite3_column_text( patch_handle, 2 )) );
-        
-        string checksum_string( (const char *) sqlite3_column_text( patch_handle, 3 ) );
-        CheckSum checksum = encoded_string_to_checksum(checksum_string);
-        if ( checksum.empty() )
-        {
-          ERR << "Wrong checksum for delta, skipping..." << endl;
-          continue;
-        }
-        on_media.checksum(checksum);
-        on_media.downloadsize(sqlite3_column_int( patch_handle, 4 ));
-        
-        zypp::packagedelta::PatchRpm patch;
-        patch.location( on_media );
-        patch.buildtime( sqlite3_column_int( patch_handle, 5 ) );
-        
-        int baseversion_rc;
-        sqlite3_bind_int ( baseversion_handle, 1, patch_package_id );
-        while (( baseversion_rc = sqlite3_step(baseversion_handle) ) == SQLITE_ROW )
-        {
-          packagedelta::PatchRpm::BaseVersion baseversion = packagedelta::PatchRpm::BaseVersion( (const char *) sqlite3_column_text( baseversion_handle, 0 ) , (const char *) sqlite3_column_text( baseversion_handle, 1 ), sqlite3_column_int( baseversion_handle, 2 ) );
-          patch.baseversion(baseversion);
-        }
-        sqlite3_reset(baseversion_handle);
-         
-        impl->addPatchRpm(patch);
+        for (list<packagedelta::PatchRpm>::const_iterator it = patch_it->second.begin(); it != patch_it->second.end(); ++it)
+          impl->addPatchRpm( *it );
       }
-     
+
       // Collect basic Resolvable data
       NVRAD dataCollect( name,
                          Edition( version, release, epoch ),
@@ -767,22 +1025,19 @@ DbSourceImpl::createPackages(void)
       Package::Ptr package = detail::makeResolvableFromImpl( dataCollect, impl );
       _store.insert( package );
       if ( _idmap != 0)
-        (*_idmap)[id] = package;
+        (*_idmap)[id + _id_offset] = package;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create package object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
-    // next package
-    sqlite3_reset(delta_handle);
-    sqlite3_reset(patch_handle);
   }
 
-  sqlite3_finalize(delta_handle);
-  sqlite3_finalize(baseversion_handle);
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -790,10 +1045,12 @@ DbSourceImpl::createPackages(void)
 void
 DbSourceImpl::createPatches(void)
 {
-  sqlite3_stmt *handle = create_patch_handle( _db );
+  sqlite3_stmt *handle = create_patch_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text( handle, 1, _source.id().c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 1, _content.c_str(), -1, SQLITE_STATIC );
+
+  beginDependencyScan( "patches" );
 
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -824,17 +1081,19 @@ DbSourceImpl::createPatches(void)
       _store.insert( patch );
       XXX << "Patch[" << id << "] " << *patch << endl;
       if ( _idmap != 0)
-        (*_idmap)[id] = patch;
+        (*_idmap)[id + _id_offset] = patch;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create patch object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -842,10 +1101,12 @@ DbSourceImpl::createPatches(void)
 void
 DbSourceImpl::createPatterns(void)
 {
-  sqlite3_stmt *handle = create_pattern_handle( _db );
+  sqlite3_stmt *handle = create_pattern_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text( handle, 1, _source.id().c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 1, _content.c_str(), -1, SQLITE_STATIC );
+
+  beginDependencyScan( "patterns" );
 
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -876,17 +1137,19 @@ DbSourceImpl::createPatterns(void)
       _store.insert( pattern );
       XXX << "Pattern[" << id << "] " << *pattern << endl;
       if ( _idmap != 0)
-        (*_idmap)[id] = pattern;
+        (*_idmap)[id + _id_offset] = pattern;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create pattern object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -894,10 +1157,12 @@ DbSourceImpl::createPatterns(void)
 void
 DbSourceImpl::createProducts(void)
 {
-  sqlite3_stmt *handle = create_product_handle( _db );
+  sqlite3_stmt *handle = create_product_handle( _db, _catalog_where );
   if (handle == NULL) return;
 
-  sqlite3_bind_text( handle, 1, _source.id().c_str(), -1, SQLITE_STATIC );
+  sqlite3_bind_text( handle, 1, _content.c_str(), -1, SQLITE_STATIC );
+
+  beginDependencyScan( "products" );
 
   int rc;
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -932,17 +1197,19 @@ DbSourceImpl::createProducts(void)
       _store.insert( product );
       XXX << "Product[" << id << "] " << *product << endl;
       if ( _idmap != 0)
-        (*_idmap)[id] = product;
+        (*_idmap)[id + _id_offset] = product;
     }
     catch (const Exception & excpt_r)
     {
       ERR << "Cannot create product object '" << name << "' from catalog '" << _source.id() << "'" << endl;
-      sqlite3_finalize (handle);
+      sqlite3_reset (handle);
+      endDependencyScan();
       ZYPP_RETHROW (excpt_r);
     }
   }
 
-  sqlite3_finalize (handle);
+  sqlite3_reset (handle);
+  endDependencyScan();
   return;
 }
 
@@ -999,6 +1266,50 @@ target2kind( RCDependencyTarget dep_target )
 }
 
 
+// add cap to deps according to RC dependency type
+
+static void
+add_dependency( Dependencies & deps, RCDependencyType dep_type, const Capability & cap )
+{
+  switch ( dep_type)
+  {
+  case RC_DEP_TYPE_REQUIRE:
+    deps[Dep::REQUIRES].insert( cap );
+    break;
+  case RC_DEP_TYPE_PROVIDE:
+    deps[Dep::PROVIDES].insert( cap );
+    break;
+  case RC_DEP_TYPE_CONFLICT:
+    deps[Dep::CONFLICTS].insert( cap );
+    break;
+  case RC_DEP_TYPE_OBSOLETE:
+    deps[Dep::OBSOLETES].insert( cap );
+    break;
+  case RC_DEP_TYPE_PREREQUIRE:
+    deps[Dep::PREREQUIRES].insert( cap );
+    break;
+  case RC_DEP_TYPE_FRESHEN:
+    deps[Dep::FRESHENS].insert( cap );
+    break;
+  case RC_DEP_TYPE_RECOMMEND:
+    deps[Dep::RECOMMENDS].insert( cap );
+    break;
+  case RC_DEP_TYPE_SUGGEST:
+    deps[Dep::SUGGESTS].insert( cap );
+    break;
+  case RC_DEP_TYPE_SUPPLEMENT:
+    deps[Dep::SUPPLEMENTS].insert( cap );
+    break;
+  case RC_DEP_TYPE_ENHANCE:
+    deps[Dep::ENHANCES].insert( cap );
+    break;
+  default:
+    ERR << "Unhandled dep_type " << dep_type << endl;
+    break;
+  }
+}
+
+
 Dependencies
 DbSourceImpl::createDependenciesOnPolicy(sqlite_int64 resolvable_id)
 {
@@ -1008,109 +1319,533 @@ DbSourceImpl::createDependenciesOnPolicy(sqlite_int64 resolvable_id)
     return Dependencies();
 }
 
+// dependency name for dep_names.id, cached for the lifetime of the source
+
+const std::string &
+DbSourceImpl::depName (sqlite_int64 name_id)
+{
+  DepNameMap::const_iterator it = _dep_names.find( name_id );
+  if (it != _dep_names.end())
+    return it->second;
+
+  string & name = _dep_names[name_id];
+  if (_dep_name_handle == NULL)
+  {
+    ERR << "No dep_names, can't resolve dependency name id " << name_id << endl;
+    return name;
+  }
+  sqlite3_bind_int64 ( _dep_name_handle, 1, name_id);
+  if (sqlite3_step( _dep_name_handle) == SQLITE_ROW)
+  {
+    const char *text = (const char *)sqlite3_column_text( _dep_name_handle, 0);
+    if (text != NULL)
+      name = text;
+  }
+  else
+  {
+    ERR << "Unknown dependency name id " << name_id << endl;
+  }
+  sqlite3_reset ( _dep_name_handle);
+  return name;
+}
+
+// paths required by any resolvable of db, as subquery for readFileProvides()
+//  file_requires has the requires of all rows written by the backend since
+//  it records them, older rows (and zmd's) are found in the dependency tables.
+
+static string
+required_files_query( sqlite3 *db )
+{
+  string types( "IN (" + str::numstring( RC_DEP_TYPE_REQUIRE ) + "," + str::numstring( RC_DEP_TYPE_PREREQUIRE ) + ")" );
+  string paths( ">= '/' AND name < '0'" );		// name starts with '/', index friendly
+  bool have_dep_names = table_has_rows( db, "dep_names" );
+
+  string query( "SELECT name FROM file_requires" );
+  query += " UNION SELECT name FROM dependencies WHERE dep_type " + types + " AND name " + paths;
+  if (have_dep_names
+      && DbAccess::haveColumn( db, "dependencies", "name_id" ))
+  {
+    query += " UNION SELECT name FROM dep_names WHERE name " + paths
+             + " AND id IN (SELECT name_id FROM dependencies WHERE dep_type " + types + ")";
+  }
+  if (table_has_rows( db, "dependency_set_rows" ))
+  {
+    query += " UNION SELECT name FROM dependency_set_rows WHERE dep_type " + types + " AND name " + paths;
+    if (have_dep_names)
+      query += " UNION SELECT name FROM dep_names WHERE name " + paths
+               + " AND id IN (SELECT name_id FROM dependency_set_rows WHERE dep_type " + types + ")";
+  }
+  return query;
+}
+
+// file provides of the catalog whose path is required by some resolvable
+//  A shard only knows the requires of its own catalog, all file provides
+//  of a sharded catalog are read.
+
+void
+DbSourceImpl::readFileProvides (void)
+{
+  string query(
+    "SELECT resolvable_id, name, dep_target FROM file_provides"
+    " WHERE resolvable_id IN (SELECT id FROM resolvables WHERE " + _catalog_where + ")" );
+  if (_shard_db == NULL)
+    query += " AND name IN (" + required_files_query( _db ) + ")";
+
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare (_db, query.c_str(), -1, &handle, NULL) != SQLITE_OK)
+  {
+    ERR << "Can not read file provides: " << sqlite3_errmsg (_db) << endl;
+    sqlite3_finalize (handle);
+    return;
+  }
+  sqlite3_bind_text (handle, 1, _content.c_str(), -1, SQLITE_STATIC);
+
+  unsigned count = 0;
+  int rc;
+  while ((rc = sqlite3_step( handle)) == SQLITE_ROW)
+  {
+    sqlite_int64 id = sqlite3_column_int64( handle, 0);
+    const char *name = (const char *)sqlite3_column_text( handle, 1);
+    if (name == NULL)
+      continue;
+    try
+    {
+      _file_provides[id].insert( parseCapability( (RCDependencyTarget)sqlite3_column_int( handle, 2 ), name ) );
+      ++count;
+    }
+    catch ( Exception & excpt_r )
+    {
+      ERR << "Can't parse file provides for " << id << ", name '" << name << "'" << endl;
+      ZYPP_CAUGHT( excpt_r );
+    }
+  }
+  if (rc != SQLITE_DONE)
+    ERR << "Error reading file provides: " << sqlite3_errmsg (_db) << endl;
+  sqlite3_finalize (handle);
+
+  MIL << "Catalog " << _source.id() << ": " << count << " required file provides" << endl;
+}
+
+
 Dependencies
 DbSourceImpl::createDependencies (sqlite_int64 resolvable_id)
 {
-  //FIXME
-  //return Dependencies();
-  Dependencies deps;
-  CapFactory factory;
+  Dependencies deps = storedDependencies( resolvable_id );
 
+  FileProvidesMap::const_iterator it = _file_provides.find( resolvable_id );
+  if (it != _file_provides.end())
+    deps[Dep::PROVIDES].insert( it->second.begin(), it->second.end() );	// copy on write, dependency sets stay shared
+
+  return deps;
+}
+
+
+Dependencies
+DbSourceImpl::storedDependencies (sqlite_int64 resolvable_id)
+{
   if (  _dependency_handle == NULL )
   {
     ERR << "sqlite dependency statement not prepared." << endl;
     return Dependencies();
   }
-  
-  //MIL << "Dependencies for resolvable " << resolvable_id << endl;
-  sqlite3_bind_int64 ( _dependency_handle, 1, resolvable_id);
 
-  RCDependencyType dep_type;
-  string name, version, release;
-  unsigned epoch;
-  Arch arch;
-  Rel rel;
+  if (_have_dep_sets)
+  {
+    sqlite_int64 set_id = 0;
+    sqlite3_bind_int64 ( _res_dep_set_handle, 1, resolvable_id);
+    if (sqlite3_step( _res_dep_set_handle) == SQLITE_ROW)
+      set_id = sqlite3_column_int64( _res_dep_set_handle, 0);
+    sqlite3_reset ( _res_dep_set_handle);
+
+    if (set_id > 0)
+    {
+      // built once per set, all resolvables of the set share it
+      DepSetMap::const_iterator it = _dep_sets.find( set_id );
+      if (it != _dep_sets.end())
+        return it->second;
+      Dependencies deps = readDependencies( _dep_set_handle, true, set_id );
+      _dep_sets[set_id] = deps;
+      return deps;
+    }
+  }
+
+  if (_have_loaded_rows)
+  {
+    // rows of each resolvable are needed once, drop them as we go
+    Dependencies deps;
+    DbDependencyRowMap::iterator it = _loaded_rows.find( resolvable_id );
+    if (it != _loaded_rows.end())
+    {
+      deps = unpackDependencies( it->second, resolvable_id );
+      _loaded_rows.erase( it );
+    }
+    return deps;
+  }
+
+  if (_have_dep_blobs)
+  {
+    bool unpacked = false;
+    sqlite3_bind_int64 ( _dep_blob_handle, 1, resolvable_id);
+    if (sqlite3_step( _dep_blob_handle) == SQLITE_ROW)
+    {
+      const void *blob = sqlite3_column_blob( _dep_blob_handle, 0);
+      int size = sqlite3_column_bytes( _dep_blob_handle, 0);
+      unpacked = dep_blob_decode( blob, size, _dep_rows );
+      if (!unpacked)
+        ERR << "Bad dependency blob for resolvable_id " << resolvable_id << ", reading dependencies table" << endl;
+    }
+    sqlite3_reset ( _dep_blob_handle);
+    if (unpacked)
+      return unpackDependencies( _dep_rows, resolvable_id );
+  }
+
+  if (_dep_scan_handle != NULL)
+    return scanDependencies( resolvable_id );
+  return readDependencies( _dependency_handle, _have_dep_name_ids, resolvable_id );
+}
+
+
+// capability of an unversioned dependency, from the cache if attached
+//  throws like CapFactory::parse()
+
+Capability
+DbSourceImpl::parseCapability (RCDependencyTarget target, const std::string & name)
+{
+  if (_cap_cache == NULL)
+    return CapFactory().parse( target2kind( target ), name );
+
+  DbCapabilityCache::Key key = _cap_cache->key( target, name );
+  const Capability *cached = _cap_cache->find( key );
+  if (cached != NULL)
+    return *cached;
+
+  Capability cap = CapFactory().parse( target2kind( target ), name );
+  _cap_cache->insert( key, cap );
+  return cap;
+}
+
+
+// capability of a versioned dependency, from the cache if attached
+
+Capability
+DbSourceImpl::parseCapability (RCDependencyTarget target, const std::string & name, RCResolvableRelation relation, const std::string & version, const std::string & release, int epoch)
+{
+  if (_cap_cache == NULL)
+    return CapFactory().parse( target2kind( target ), name, DbAccess::Rc2Rel( relation ), Edition( version, release, epoch ) );
+
+  DbCapabilityCache::Key key = _cap_cache->key( target, name, relation, version, release, epoch );
+  const Capability *cached = _cap_cache->find( key );
+  if (cached != NULL)
+    return *cached;
+
+  Capability cap = CapFactory().parse( target2kind( target ), name, DbAccess::Rc2Rel( relation ), Edition( version, release, epoch ) );
+  _cap_cache->insert( key, cap );
+  return cap;
+}
+
+
+// build dependencies from decoded blob rows, see DbDependencyBlob.h
+
+Dependencies
+DbSourceImpl::unpackDependencies (const std::vector<DbDependencyRow> & rows, sqlite_int64 resolvable_id)
+{
+  Dependencies deps;
   Capability cap;
-  Resolvable::Kind dkind;
 
-  const char *text;
-  int rc;
-  while ((rc = sqlite3_step( _dependency_handle)) == SQLITE_ROW)
+  for (vector<DbDependencyRow>::const_iterator it = rows.begin(); it != rows.end(); ++it)
   {
-    //MIL << "2 - Dependencies for resolvable " << resolvable_id << endl;
-    
+    const string & name( it->name_id > 0 ? depName( it->name_id ) : it->name );
     try
     {
-      dep_type = (RCDependencyType)sqlite3_column_int( _dependency_handle, 0);
-      name = string ( (const char *)sqlite3_column_text( _dependency_handle, 1) );
-      text = (const char *)sqlite3_column_text( _dependency_handle, 2);
-      dkind = target2kind( (RCDependencyTarget)sqlite3_column_int( _dependency_handle, 7 ) );
-
-      if (text == NULL)
-      {
-        cap = factory.parse( dkind, name );
-      }
+      if (it->versioned)
+        cap = parseCapability( (RCDependencyTarget)it->dep_target, name, (RCResolvableRelation)it->relation, it->version, it->release, it->epoch );
       else
-      {
-        version = text;
-        text = (const char *)sqlite3_column_text( _dependency_handle, 3);
-        if (text != NULL)
-          release = text;
-        else
-          release.clear();
-        epoch = sqlite3_column_int( _dependency_handle, 4 );
-        arch = DbAccess::Rc2Arch( (RCArch) sqlite3_column_int( _dependency_handle, 5 ) );
-        rel = DbAccess::Rc2Rel( (RCResolvableRelation) sqlite3_column_int( _dependency_handle, 6 ) );
-
-        cap = factory.parse( dkind, name, rel, Edition( version, release, epoch ) );
-      }
-
-      switch ( dep_type)
-      {
-      case RC_DEP_TYPE_REQUIRE:
-        deps[Dep::REQUIRES].insert( cap );
-        break;
-      case RC_DEP_TYPE_PROVIDE:
-        deps[Dep::PROVIDES].insert( cap );
-        break;
-      case RC_DEP_TYPE_CONFLICT:
-        deps[Dep::CONFLICTS].insert( cap );
-        break;
-      case RC_DEP_TYPE_OBSOLETE:
-        deps[Dep::OBSOLETES].insert( cap );
-        break;
-      case RC_DEP_TYPE_PREREQUIRE:
-        deps[Dep::PREREQUIRES].insert( cap );
-        break;
-      case RC_DEP_TYPE_FRESHEN:
-        deps[Dep::FRESHENS].insert( cap );
-        break;
-      case RC_DEP_TYPE_RECOMMEND:
-        deps[Dep::RECOMMENDS].insert( cap );
-        break;
-      case RC_DEP_TYPE_SUGGEST:
-        deps[Dep::SUGGESTS].insert( cap );
-        break;
-      case RC_DEP_TYPE_SUPPLEMENT:
-        deps[Dep::SUPPLEMENTS].insert( cap );
-        break;
-      case RC_DEP_TYPE_ENHANCE:
-        deps[Dep::ENHANCES].insert( cap );
-        break;
-      default:
-        ERR << "Unhandled dep_type " << dep_type << endl;
-        break;
-      }
+        cap = parseCapability( (RCDependencyTarget)it->dep_target, name );
+      add_dependency( deps, (RCDependencyType)it->dep_type, cap );
     }
     catch ( Exception & excpt_r )
     {
-      ERR << "Can't parse dependencies for resolvable_id " << resolvable_id << ", name '" << name << "', version '" << version << "', release '" << release << "'" << endl;
+      ERR << "Can't parse dependencies for " << resolvable_id << ", name '" << name << "', version '" << it->version << "', release '" << it->release << "'" << endl;
       ZYPP_CAUGHT( excpt_r );
     }
   }
+  return deps;
+}
+
+
+// add the dependency in the current row of handle (see create_dependency_handle()) to deps
 
-  sqlite3_reset ( _dependency_handle);
+void
+DbSourceImpl::addDependency (Dependencies & deps, sqlite3_stmt *handle, bool with_name_id, sqlite_int64 owner_id)
+{
+  string name, version, release;
+  const char *text;
+
+  try
+  {
+    RCDependencyType dep_type = (RCDependencyType)sqlite3_column_int( handle, 0);
+    if (with_name_id
+        && sqlite3_column_type( handle, 8) != SQLITE_NULL)
+    {
+      name = depName( sqlite3_column_int64( handle, 8) );
+    }
+    else
+    {
+      text = (const char *)sqlite3_column_text( handle, 1);
+      name = (text != NULL) ? text : "";
+    }
+    text = (const char *)sqlite3_column_text( handle, 2);
+    RCDependencyTarget target = (RCDependencyTarget)sqlite3_column_int( handle, 7 );
+
+    Capability cap;
+    if (text == NULL)
+    {
+      cap = parseCapability( target, name );
+    }
+    else
+    {
+      version = text;
+      text = (const char *)sqlite3_column_text( handle, 3);
+      if (text != NULL)
+        release = text;
+      unsigned epoch = sqlite3_column_int( handle, 4 );
+
+      cap = parseCapability( target, name, (RCResolvableRelation) sqlite3_column_int( handle, 6 ), version, release, epoch );
+    }
+
+    add_dependency( deps, dep_type, cap );
+  }
+  catch ( Exception & excpt_r )
+  {
+    ERR << "Can't parse dependencies for " << owner_id << ", name '" << name << "', version '" << version << "', release '" << release << "'" << endl;
+    ZYPP_CAUGHT( excpt_r );
+  }
+}
+
+
+// read dependency rows of owner (resolvable or dependency set) from handle, see create_dependency_handle()
+
+Dependencies
+DbSourceImpl::readDependencies (sqlite3_stmt *handle, bool with_name_id, sqlite_int64 owner_id)
+{
+  Dependencies deps;
+
+  sqlite3_bind_int64 ( handle, 1, owner_id);
+  while (sqlite3_step( handle) == SQLITE_ROW)
+  {
+    addDependency( deps, handle, with_name_id, owner_id );
+  }
+
+  sqlite3_reset ( handle);
+  return deps;
+}
+
+
+//-----------------------------------------------------------------------------
+// dependency scan
+//
+// Instead of looking up the dependencies of each resolvable, a createX()
+// walks the dependencies of all its resolvables in one query ordered by
+// resolvable_id. Its resolvables are read ordered by id as well, so
+// scanDependencies() merges both, consuming the rows of each resolvable
+// as it comes along.
+
+// scan the dependencies of the resolvables in table or view from (of kind, if >= 0)
+//  false if the scan can't be prepared, the dependencies are looked up then
+
+bool
+DbSourceImpl::beginDependencyScan (const std::string & from, int kind)
+{
+  endDependencyScan();
+  if (_have_loaded_rows)
+    return false;		// storedDependencies() takes the loaded rows
+
+  string query =
+    //	      0         1     2        3        4      5     6         7
+    "SELECT dep_type, name, version, release, epoch, arch, relation, dep_target";
+  if (_have_dep_name_ids)
+    query += ", name_id";	// 8
+  query += ", resolvable_id FROM dependencies"
+           " WHERE resolvable_id IN (SELECT id FROM " + from + " WHERE " + _catalog_where;
+  if (kind >= 0)
+    query += " AND kind = ?";
+  query += ") ORDER BY resolvable_id";
+
+  if (sqlite3_prepare ( _db, query.c_str(), -1, &_dep_scan_handle, NULL) != SQLITE_OK)
+  {
+    ERR << "Can not prepare dependency scan: " << sqlite3_errmsg ( _db) << endl;
+    sqlite3_finalize (_dep_scan_handle);
+    _dep_scan_handle = NULL;
+    return false;
+  }
+  sqlite3_bind_text (_dep_scan_handle, 1, _content.c_str(), -1, SQLITE_STATIC);
+  if (kind >= 0)
+    sqlite3_bind_int (_dep_scan_handle, 2, kind);
+
+  _dep_scan_id_column = _have_dep_name_ids ? 9 : 8;
+  _dep_scan_rc = sqlite3_step( _dep_scan_handle );
+  return true;
+}
+
+
+void
+DbSourceImpl::endDependencyScan (void)
+{
+  if (_dep_scan_handle == NULL)
+    return;
+  if (_dep_scan_rc != SQLITE_ROW
+      && _dep_scan_rc != SQLITE_DONE)
+  {
+    ERR << "Error scanning dependencies: " << sqlite3_errmsg ( _db) << endl;
+  }
+  sqlite3_finalize (_dep_scan_handle);
+  _dep_scan_handle = NULL;
+}
+
+
+// dependencies of resolvable_id from the scan, ids must come in ascending order
+
+Dependencies
+DbSourceImpl::scanDependencies (sqlite_int64 resolvable_id)
+{
+  Dependencies deps;
+  while (_dep_scan_rc == SQLITE_ROW)
+  {
+    sqlite_int64 owner_id = sqlite3_column_int64( _dep_scan_handle, _dep_scan_id_column );
+    if (owner_id > resolvable_id)
+      break;
+    if (owner_id == resolvable_id)
+    {
+      addDependency( deps, _dep_scan_handle, _have_dep_name_ids, resolvable_id );
+      ++_dep_scan_rows;
+    }
+    _dep_scan_rc = sqlite3_step( _dep_scan_handle );
+  }
   return deps;
 }
 
+
+//-----------------------------------------------------------------------------
+// dependency rows of a whole catalog, see DbCatalogLoader
+
+// decode the dependency blobs of the resolvables matching where into rows
+
+static bool
+read_blob_rows( sqlite3 *db, const string & where, const string & content, DbDependencyRowMap & rows, string & error )
+{
+  string query( "SELECT resolvable_id, deps FROM resolvable_dep_blobs"
+                " WHERE resolvable_id IN (SELECT id FROM resolvables WHERE " + where + ")" );
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare ( db, query.c_str(), -1, &handle, NULL) != SQLITE_OK)
+  {
+    error = string( "Can not read dependency blobs: " ) + sqlite3_errmsg( db );
+    sqlite3_finalize (handle);
+    return false;
+  }
+  sqlite3_bind_text (handle, 1, content.c_str(), -1, SQLITE_STATIC);
+
+  vector<DbDependencyRow> decoded;
+  int rc;
+  while ((rc = sqlite3_step( handle)) == SQLITE_ROW)
+  {
+    // a bad blob leaves the resolvable to the dependencies table, like storedDependencies()
+    if (dep_blob_decode( sqlite3_column_blob( handle, 1), sqlite3_column_bytes( handle, 1), decoded ))
+      rows[sqlite3_column_int64( handle, 0)].swap( decoded );
+  }
+  if (rc != SQLITE_DONE)
+    error = string( "Error reading dependency blobs: " ) + sqlite3_errmsg( db );
+  sqlite3_finalize (handle);
+  return rc == SQLITE_DONE;
+}
+
+
+bool
+DbSourceImpl::readDependencyRows( sqlite3 *db, const std::string & content, DbDependencyRowMap & rows, std::string & error )
+{
+  string where = catalog_condition( db, content );
+
+  if (table_has_rows( db, "resolvable_dep_blobs" )
+      && !read_blob_rows( db, where, content, rows, error ))
+  {
+    return false;
+  }
+
+  string query =
+    //	      0         1     2        3        4      5     6         7           8
+    "SELECT dep_type, name, version, release, epoch, arch, relation, dep_target, resolvable_id";
+  string from =
+    " FROM dependencies WHERE resolvable_id IN (SELECT id FROM resolvables WHERE " + where + ")"
+    " ORDER BY resolvable_id";
+
+  // dependencies.name_id is only present if the backend ever wrote to this db
+  bool with_name_id = true;
+  sqlite3_stmt *handle = NULL;
+  if (sqlite3_prepare ( db, (query + ", name_id" + from).c_str(), -1, &handle, NULL) != SQLITE_OK)	// 9
+  {
+    sqlite3_finalize (handle);
+    handle = NULL;
+    with_name_id = false;
+    if (sqlite3_prepare ( db, (query + from).c_str(), -1, &handle, NULL) != SQLITE_OK)
+    {
+      error = string( "Can not read dependencies: " ) + sqlite3_errmsg( db );
+      sqlite3_finalize (handle);
+      return false;
+    }
+  }
+  sqlite3_bind_text (handle, 1, content.c_str(), -1, SQLITE_STATIC);
+
+  sqlite_int64 last_id = 0;
+  vector<DbDependencyRow> *owner = NULL;	// rows of last_id, NULL if it has a blob
+  int rc;
+  while ((rc = sqlite3_step( handle)) == SQLITE_ROW)
+  {
+    sqlite_int64 id = sqlite3_column_int64( handle, 8 );
+    if (owner == NULL
+        || id != last_id)
+    {
+      last_id = id;
+      DbDependencyRowMap::iterator it = rows.find( id );
+      if (it == rows.end())
+        owner = &(rows.insert( rows.end(), make_pair( id, vector<DbDependencyRow>() ) )->second);
+      else
+        owner = NULL;		// blob read above
+    }
+    if (owner == NULL)
+      continue;
+
+    owner->push_back( DbDependencyRow() );
+    DbDependencyRow & row( owner->back() );
+    row.resolvable_id = id;
+    row.dep_type = sqlite3_column_int( handle, 0 );
+    if (with_name_id
+        && sqlite3_column_type( handle, 9 ) != SQLITE_NULL)
+    {
+      row.name_id = sqlite3_column_int64( handle, 9 );
+    }
+    else
+    {
+      const char *text = (const char *) sqlite3_column_text( handle, 1 );
+      if (text != NULL)
+        row.name = text;
+    }
+    const char *text = (const char *) sqlite3_column_text( handle, 2 );
+    if (text != NULL)
+    {
+      row.versioned = true;
+      row.version = text;
+      text = (const char *) sqlite3_column_text( handle, 3 );
+      if (text != NULL)
+        row.release = text;
+      row.epoch = sqlite3_column_int( handle, 4 );
+    }
+    row.arch = sqlite3_column_int( handle, 5 );
+    row.relation = sqlite3_column_int( handle, 6 );
+    row.dep_target = sqlite3_column_int( handle, 7 );
+  }
+  if (rc != SQLITE_DONE)
+    error = string( "Error reading dependencies: " ) + sqlite3_errmsg( db );
+  sqlite3_finalize (handle);
+  return rc == SQLITE_DONE;
+}
+
 // EOF
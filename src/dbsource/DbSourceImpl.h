@@ -24,11 +24,15 @@
 
 #include <iosfwd>
 #include <string>
+#include <tr1/unordered_map>
 
 #include "zypp/source/SourceImpl.h"
 #include "zypp/media/MediaManager.h"
 
 #include "DbAccess.h"
+#include "DbCapabilityCache.h"
+#include "DbCatalogLoader.h"
+#include "DbPackageDetails.h"
 
 #include "zypp/Package.h"
 #include "zypp/Atom.h"
@@ -84,6 +88,30 @@ private:
 
   sqlite3 *_db;
   sqlite3_stmt *_dependency_handle;
+  sqlite3_stmt *_dep_name_handle;
+  bool _have_dep_name_ids;		// dependencies.name_id exists
+
+  typedef std::tr1::unordered_map<sqlite_int64, std::string> DepNameMap;
+  DepNameMap _dep_names;		// dep_names.id -> name, filled on demand
+
+  sqlite3_stmt *_res_dep_set_handle;
+  sqlite3_stmt *_dep_set_handle;
+  bool _have_dep_sets;			// resolvable_dep_sets in use
+  typedef std::map<sqlite_int64, zypp::Dependencies> DepSetMap;
+  DepSetMap _dep_sets;			// dependency_sets.id -> Dependencies, shared
+
+  sqlite3_stmt *_dep_blob_handle;
+  bool _have_dep_blobs;			// resolvable_dep_blobs in use
+  std::vector<DbDependencyRow> _dep_rows;	// scratch for decoded blobs
+
+  sqlite3_stmt *_dep_scan_handle;	// dependencies of the current createX(), see beginDependencyScan()
+  int _dep_scan_rc;			// sqlite3_step() result for its current row
+  int _dep_scan_id_column;		// resolvable_id in its rows
+  unsigned _dep_scan_rows;		// rows taken from all scans, for the log
+
+  typedef std::map<sqlite_int64, zypp::CapSet> FileProvidesMap;
+  FileProvidesMap _file_provides;	// resolvable id -> required file provides, see readFileProvides()
+  std::string _catalog_where;		// selects the catalog in the create_*_handle() queries
   sqlite3_stmt *_message_handle;
   sqlite3_stmt *_script_handle;
   sqlite3_stmt *_patch_handle;
@@ -110,6 +138,52 @@ private:
    */
   zypp::Dependencies createDependencies (sqlite_int64 resolvable_id);
 
+  /**
+   * dependencies stored with the resolvable (rows, set or blob)
+   */
+  zypp::Dependencies storedDependencies (sqlite_int64 resolvable_id);
+
+  /**
+   * reads the file provides of the catalog some resolvable requires
+   */
+  void readFileProvides (void);
+
+  /**
+   * scans the dependencies of the resolvables in from (of kind, if >= 0) ordered by id
+   */
+  bool beginDependencyScan (const std::string & from, int kind = -1);
+  void endDependencyScan (void);
+  /**
+   * dependencies of resolvable_id from the scan, ids must ascend
+   */
+  zypp::Dependencies scanDependencies (sqlite_int64 resolvable_id);
+
+  /**
+   * adds the dependency in the current row of handle to deps
+   */
+  void addDependency (zypp::Dependencies & deps, sqlite3_stmt *handle, bool with_name_id, sqlite_int64 owner_id);
+
+  /**
+   * reads dependencies of owner_id from handle
+   */
+  zypp::Dependencies readDependencies (sqlite3_stmt *handle, bool with_name_id, sqlite_int64 owner_id);
+
+  /**
+   * creates dependencies from a decoded dependency blob
+   */
+  zypp::Dependencies unpackDependencies (const std::vector<DbDependencyRow> & rows, sqlite_int64 resolvable_id);
+
+  /**
+   * capability of a dependency, parsed or from the cache
+   */
+  zypp::Capability parseCapability (RCDependencyTarget target, const std::string & name);
+  zypp::Capability parseCapability (RCDependencyTarget target, const std::string & name, RCResolvableRelation relation, const std::string & version, const std::string & release, int epoch);
+
+  /**
+   * name of interned dependency, see DbAccess::setInternDependencyNames()
+   */
+  const std::string & depName (sqlite_int64 name_id);
+
 public:
 
   virtual const bool valid() const
@@ -123,13 +197,41 @@ public:
   }
 
   void attachDatabase( sqlite3 *db );
+  /** read the catalog from shard file instead of the attached db,
+   * resolvable ids in the IdMap are shifted by id_offset */
+  void attachShard( const std::string & file, sqlite_int64 id_offset );
+  /** read the resolvables stored for catalog content, see DbAccess::shareCatalog() */
+  void attachContent( const std::string & content );
+  /** parse capabilities through cache, shared with other sources */
+  void attachCapabilityCache( DbCapabilityCache *cache );
+  /** fetch package details through fetcher, shared with other sources of the db */
+  void attachPackageDetails( DbPackageDetails_Ptr fetcher );
+  /** take the dependency rows from job of loader instead of reading them */
+  void attachLoader( zypp::shared_ptr<DbCatalogLoader> loader, unsigned job );
   void attachIdMap (IdMap *idmap);
   void attachZyppSource( zypp::Source_Ref source );
 
+  /**
+   * reads the dependency rows (packed or not) of catalog content from db,
+   * rows of dependency sets are left out. Used by DbCatalogLoader in its
+   * threads, so plain rows only and no logging.
+   */
+  static bool readDependencyRows( sqlite3 *db, const std::string & content, DbDependencyRowMap & rows, std::string & error );
+
 private:
   zypp::Source_Ref _source;		// reference to DbSource for this Impl
   zypp::Source_Ref _zyppsource;	// reference to real zypp source, if exists
+  std::string _content;			// catalog the resolvables are stored for
+  std::string _shard_file;		// db file of sharded catalog
+  sqlite3 *_shard_db;			// its connection, see createResolvables()
+  sqlite_int64 _id_offset;		// added to ids of shard resolvables in _idmap
   IdMap *_idmap;			// map sqlite resolvable.id to actual objects
+  DbCapabilityCache *_cap_cache;	// parsed capabilities, see parseCapability()
+  DbPackageDetails_Ptr _package_details;	// lazy package details, of _shard_db if sharded
+  zypp::shared_ptr<DbCatalogLoader> _loader;	// reads the dependency rows ahead, see createResolvables()
+  unsigned _loader_job;
+  bool _have_loaded_rows;		// _loaded_rows hold all dependency rows of the catalog
+  DbDependencyRowMap _loaded_rows;	// taken from _loader, consumed by storedDependencies()
   void createResolvables( zypp::Source_Ref source_r );
   DbSourceImplPolicy _policy;
 };
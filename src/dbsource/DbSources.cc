@@ -46,10 +46,15 @@ DbSources::DbSources (sqlite3 *db)
     : _db (db)
 {
   MIL << "DbSources::DbSources(" << db << ")" << endl;
+  if (_db != NULL)
+    _package_details = new DbPackageDetails( _db );
 }
 
 DbSources::~DbSources ()
-{}
+{
+  if (_package_details)
+    _package_details->detach();
+}
 
 
 ResObject::constPtr
@@ -130,6 +135,42 @@ DbSources::sources( bool zypp_restore, bool refresh )
     return _sources;
   }
 
+  // sharded catalogs, see DbAccess::openShard()
+  //  their resolvable ids are only unique within the shard, shift them
+  //  into a range of their own for the IdMap
+  map<string, pair<string, sqlite_int64> > shards;
+  sqlite3_stmt *shard_handle = NULL;
+  if (sqlite3_prepare (_db, "SELECT catalog, file, id FROM catalog_shards", -1, &shard_handle, NULL) == SQLITE_OK)
+  {
+    while (sqlite3_step (shard_handle) == SQLITE_ROW)
+    {
+      const char *catalog = (const char *) sqlite3_column_text( shard_handle, 0 );
+      const char *file = (const char *) sqlite3_column_text( shard_handle, 1 );
+      if (catalog == NULL || file == NULL)
+        continue;
+      shards[catalog] = make_pair( string( file ), sqlite3_column_int64( shard_handle, 2 ) << 32 );
+    }
+  }
+  sqlite3_finalize (shard_handle);	// no catalog_shards table if the backend never wrote the db
+
+  // catalogs sharing the resolvables of another one, see DbAccess::shareCatalog()
+  //  the rows (and their ids) belong to the other catalog, so only its
+  //  objects go into the IdMap
+  map<string, string> contents;
+  sqlite3_stmt *content_handle = NULL;
+  if (sqlite3_prepare (_db, "SELECT catalog, content FROM catalog_content WHERE content != catalog", -1, &content_handle, NULL) == SQLITE_OK)
+  {
+    while (sqlite3_step (content_handle) == SQLITE_ROW)
+    {
+      const char *catalog = (const char *) sqlite3_column_text( content_handle, 0 );
+      const char *content = (const char *) sqlite3_column_text( content_handle, 1 );
+      if (catalog == NULL || content == NULL)
+        continue;
+      contents[catalog] = content;
+    }
+  }
+  sqlite3_finalize (content_handle);
+
   media::MediaManager mmgr;
   _smgr = SourceManager::sourceManager();
 
@@ -144,6 +185,17 @@ DbSources::sources( bool zypp_restore, bool refresh )
 
   SourceFactory factory;
 
+  // the dependency rows of the catalogs are read ahead in threads, one
+  //  connection each, see DbCatalogLoader
+  shared_ptr<DbCatalogLoader> loader;
+  string dbfile = DbCatalogLoader::fileOf( _db );
+  unsigned cpus = DbCatalogLoader::cpus();
+  if (cpus > 1
+      && !dbfile.empty())
+  {
+    loader.reset( new DbCatalogLoader( dbfile, cpus ) );
+  }
+
   // read catalogs table
 
   while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
@@ -234,7 +286,22 @@ DbSources::sources( bool zypp_restore, bool refresh )
       impl->setSubscribed( subscribed != 0 );
 
       impl->attachDatabase( _db );
-      impl->attachIdMap( &_idmap );
+      string shard_file;
+      map<string, pair<string, sqlite_int64> >::const_iterator shard = shards.find( id );
+      if (shard != shards.end())
+      {
+        shard_file = shard->second.first;
+        impl->attachShard( shard_file, shard->second.second );
+      }
+      map<string, string>::const_iterator content = contents.find( id );
+      if (content != contents.end())
+        impl->attachContent( content->second );
+      else
+        impl->attachIdMap( &_idmap );
+      if (loader)
+        impl->attachLoader( loader, loader->add( content != contents.end() ? content->second : id, shard_file ) );
+      impl->attachCapabilityCache( &_cap_cache );
+      impl->attachPackageDetails( _package_details );
       impl->attachZyppSource( zypp_source );	// link to the real source if needed
 
       Source_Ref src( factory.createFrom( impl ) );
@@ -256,6 +323,13 @@ DbSources::sources( bool zypp_restore, bool refresh )
     _sources.clear();
   }
 
+  // a single catalog is not worth a thread, it finds the loader idle and reads as before
+  if (loader
+      && _sources.size() > 1)
+  {
+    loader->start();
+  }
+
   MIL << "Read " << _sources.size() << " catalogs" << endl;
   return _sources;
 }
@@ -35,6 +35,8 @@
 #include <zypp/PoolItem.h>
 
 #include "DbAccess.h"
+#include "DbCapabilityCache.h"
+#include "DbPackageDetails.h"
 
 ///////////////////////////////////////////////////////////////////
 //
@@ -48,6 +50,8 @@ private:
   sqlite3 *_db;
   SourcesList _sources;
   IdMap _idmap;
+  DbCapabilityCache _cap_cache;		// shared by all sources
+  DbPackageDetails_Ptr _package_details;	// lazy package details of _db, shared by all sources
   zypp::SourceManager_Ptr _smgr;
 
 public:
@@ -0,0 +1,117 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbStatementCache.cc
+ *
+*/
+
+#include <iostream>
+#include <map>
+
+#include <pthread.h>
+
+#include "zypp/base/Logger.h"
+#include "DbStatementCache.h"
+
+#undef ZYPP_BASE_LOGGER_LOGGROUP
+#define ZYPP_BASE_LOGGER_LOGGROUP "DbStatementCache"
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// the caches of all open connections
+
+typedef map<sqlite3 *, DbStatementCache *> CacheMap;
+
+static CacheMap caches;
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+DbStatementCache &
+DbStatementCache::of( sqlite3 *db )
+{
+  pthread_mutex_lock( &caches_lock );
+  DbStatementCache *& cache = caches[db];
+  if (cache == NULL)
+    cache = new DbStatementCache( db );
+  pthread_mutex_unlock( &caches_lock );
+  return *cache;
+}
+
+
+void
+DbStatementCache::release( sqlite3 *db )
+{
+  DbStatementCache *cache = NULL;
+
+  pthread_mutex_lock( &caches_lock );
+  CacheMap::iterator it = caches.find( db );
+  if (it != caches.end())
+  {
+    cache = it->second;
+    caches.erase( it );
+  }
+  pthread_mutex_unlock( &caches_lock );
+
+  if (cache != NULL)
+  {
+    MIL << "Statement cache: " << cache->hits() << " hits, " << cache->misses() << " misses" << endl;
+    delete cache;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+DbStatementCache::DbStatementCache( sqlite3 *db )
+    : _db( db )
+    , _hits( 0 )
+    , _misses( 0 )
+{
+}
+
+
+DbStatementCache::~DbStatementCache()
+{
+  clear();
+}
+
+
+sqlite3_stmt *
+DbStatementCache::get( const std::string & sql )
+{
+  sqlite3_stmt *& handle = _statements[sql];
+  if (handle != NULL)
+  {
+    if (!sqlite3_expired( handle ))
+    {
+      ++_hits;
+      sqlite3_reset( handle );
+      return handle;
+    }
+    sqlite3_finalize( handle );		// compiled against an older schema
+    handle = NULL;
+  }
+
+  ++_misses;
+  if (sqlite3_prepare( _db, sql.c_str(), -1, &handle, NULL ) != SQLITE_OK)
+  {
+    ERR << "Can not prepare '" << sql << "': " << sqlite3_errmsg (_db) << endl;
+    sqlite3_finalize( handle );
+    _statements.erase( sql );		// handle refers into the map
+    return NULL;
+  }
+  return handle;
+}
+
+
+void
+DbStatementCache::clear( void )
+{
+  for (StatementMap::iterator it = _statements.begin(); it != _statements.end(); ++it)
+    sqlite3_finalize( it->second );
+  _statements.clear();
+}
@@ -0,0 +1,70 @@
+/*---------------------------------------------------------------------\
+|                          ____ _   __ __ ___                          |
+|                         |__  / \ / / . \ . \                         |
+|                           / / \ V /|  _/  _/                         |
+|                          / /__ | | | | | |                           |
+|                         /_____||_| |_| |_|                           |
+|                                                                      |
+\---------------------------------------------------------------------*/
+/** \file zmd/backend/dbsource/DbStatementCache.h
+ *
+*/
+#ifndef ZMD_BACKEND_DBSOURCE_DBSTATEMENTCACHE_H
+#define ZMD_BACKEND_DBSOURCE_DBSTATEMENTCACHE_H
+
+#include <string>
+#include <tr1/unordered_map>
+
+#include <sqlite3.h>
+
+///////////////////////////////////////////////////////////////////
+//
+//	CLASS NAME : DbStatementCache
+//
+/** Prepared statements of one sqlite connection, keyed by their SQL text
+ *
+ * Everyone using a connection shares its cache via of(), so a statement
+ * is compiled once per connection instead of once per call. get() hands
+ * out the statement reset, the cache keeps owning it: do not finalize it
+ * and reset it when done. Statements outdated by a schema change are
+ * prepared again. release() the connection before sqlite3_close().
+*/
+
+class DbStatementCache
+{
+public:
+  /** the cache of connection db, created on first use */
+  static DbStatementCache & of( sqlite3 *db );
+  /** finalize all statements of db and drop its cache, logs the hit rate */
+  static void release( sqlite3 *db );
+
+  /** statement for sql, ready for binding, NULL on error */
+  sqlite3_stmt *get( const std::string & sql );
+  /** finalize all statements */
+  void clear( void );
+
+  unsigned hits() const
+  {
+    return _hits;
+  }
+  unsigned misses() const
+  {
+    return _misses;
+  }
+
+private:
+  DbStatementCache( sqlite3 *db );
+  ~DbStatementCache();
+  DbStatementCache( const DbStatementCache & );
+  DbStatementCache & operator=( const DbStatementCache & );
+
+  typedef std::tr1::unordered_map<std::string, sqlite3_stmt *> StatementMap;
+
+  sqlite3 *_db;
+  StatementMap _statements;
+  unsigned _hits;
+  unsigned _misses;			// prepared, first use or after a schema change
+};
+///////////////////////////////////////////////////////////////////
+
+#endif // ZMD_BACKEND_DBSOURCE_DBSTATEMENTCACHE_H
@@ -7,6 +7,7 @@
 // - back to zypp, if not there yet (#156139)
 //
 // parse-metadata <zmd.db> <metadata type> <path> <catalog id>
+// parse-metadata <zmd.db> --batch <file>   (see parse_batch())
 //
 // metadata type can be currently either 'yum' or 'installation'.
 // path would be the path on the local file system. Here's an example for
@@ -25,7 +26,10 @@
 #include <unistd.h>
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <cstring>
+#include <cstdlib>
 #include <list>
 
 #include "dbsource/zmd-backend.h"
@@ -56,11 +60,102 @@ using namespace zypp;
 
 #define SWMAN_PATH "/etc/sysconfig/sw_management"
 #define SWMAN_ZMD2ZYPP_TAG "SYNC_ZMD_TO_ZYPP"
+#define SWMAN_INTERN_DEPS_TAG "ZMD_BACKEND_INTERN_DEPENDENCIES"
+#define SWMAN_SHARE_DEPS_TAG "ZMD_BACKEND_SHARE_DEPENDENCIES"
+#define SWMAN_PACK_DEPS_TAG "ZMD_BACKEND_PACK_DEPENDENCIES"
+#define SWMAN_PACK_TEXT_TAG "ZMD_BACKEND_COMPRESS_TEXT"
+#define SWMAN_FILE_PROVIDES_TAG "ZMD_BACKEND_SPLIT_FILE_PROVIDES"
+#define SWMAN_STAGING_TAG "ZMD_BACKEND_STAGING"
+#define SWMAN_SHARDS_TAG "ZMD_BACKEND_SHARDS"
+#define SWMAN_BULK_LOAD_TAG "ZMD_BACKEND_BULK_LOAD_THRESHOLD"
+#define SWMAN_CHUNK_SIZE_TAG "ZMD_BACKEND_CHUNK_SIZE"
+#define SWMAN_SYSTEM_RESCAN_TAG "ZMD_BACKEND_SYSTEM_RESCAN"
+#define SWMAN_SHARE_CATALOGS_TAG "ZMD_BACKEND_SHARE_CATALOGS"
 
 //----------------------------------------------------------------------------
 static SourceManager_Ptr manager;
 // manager->store may be expensive
 
+// write catalog refreshes to a staging db first, see DbAccess::beginStaging()
+static bool stage_refresh = false;
+// keep each catalog in a db file of its own, see DbAccess::openShard()
+static bool shard_catalogs = false;
+// rewrite @system completely instead of syncing it, for repairs
+static bool rescan_system = false;
+// catalogs with identical metadata share their rows, see DbAccess::shareCatalog()
+static bool share_catalogs = false;
+
+static bool
+sysconfig_yes( const map<string,string> & data, const char *tag )
+{
+  map<string,string>::const_iterator it = data.find( tag );
+  return (it != data.end() && it->second == "yes");
+}
+
+// numeric value of tag, false if unset
+static bool
+sysconfig_number( const map<string,string> & data, const char *tag, unsigned & value )
+{
+  map<string,string>::const_iterator it = data.find( tag );
+  if (it == data.end() || it->second.empty())
+    return false;
+  value = strtoul( it->second.c_str(), NULL, 10 );
+  return true;
+}
+
+// apply write options from /etc/sysconfig/sw_management, call before db.openDb()
+static void
+configure_db( DbAccess & db )
+{
+  map<string,string> data = zypp::base::sysconfig::read( SWMAN_PATH );
+  if (sysconfig_yes( data, SWMAN_INTERN_DEPS_TAG ))
+  {
+    MIL << "Interning dependency names" << endl;
+    db.setInternDependencyNames( true );
+  }
+  if (sysconfig_yes( data, SWMAN_SHARE_DEPS_TAG ))
+  {
+    MIL << "Sharing dependency sets" << endl;
+    db.setShareDependencySets( true );
+  }
+  if (sysconfig_yes( data, SWMAN_PACK_DEPS_TAG ))
+  {
+    MIL << "Packing dependencies" << endl;
+    db.setPackDependencies( true );
+  }
+  if (sysconfig_yes( data, SWMAN_FILE_PROVIDES_TAG ))
+  {
+    MIL << "Splitting off file provides" << endl;
+    db.setSplitFileProvides( true );
+  }
+  if (sysconfig_yes( data, SWMAN_PACK_TEXT_TAG ))
+  {
+    MIL << "Packing summaries and descriptions" << endl;
+    db.setPackText( true );
+  }
+  unsigned threshold;
+  if (sysconfig_number( data, SWMAN_BULK_LOAD_TAG, threshold ))
+  {
+    MIL << "Bulk load threshold " << threshold << endl;
+    db.setBulkLoadThreshold( threshold );
+  }
+  stage_refresh = sysconfig_yes( data, SWMAN_STAGING_TAG );
+  unsigned chunk_size = DbAccess::DEFAULT_CHUNK_SIZE;
+  if (sysconfig_number( data, SWMAN_CHUNK_SIZE_TAG, chunk_size )
+      && chunk_size > 0)
+  {
+    if (!stage_refresh)				// chunks go to the staging tables only
+      MIL << "Chunk size set, staging refreshes" << endl;
+    stage_refresh = true;
+    MIL << "Committing staged rows every " << chunk_size << " resolvables" << endl;
+    db.setChunkSize( chunk_size );
+  }
+  db.setReportProgress( true );
+  shard_catalogs = sysconfig_yes( data, SWMAN_SHARDS_TAG );
+  rescan_system = sysconfig_yes( data, SWMAN_SYSTEM_RESCAN_TAG );
+  share_catalogs = sysconfig_yes( data, SWMAN_SHARE_CATALOGS_TAG );
+}
+
 // query system for installed packages
 static int
 query_system ( ZYpp::Ptr zypp, const Pathname &rpm_prefix, const std::string &dbfile )
@@ -71,12 +166,26 @@ query_system ( ZYpp::Ptr zypp, const Pathname &rpm_prefix, const std::string &db
   Target_Ptr target = backend::initTarget( zypp, rpm_prefix );
 
   DbAccess db( dbfile );
+  configure_db( db );
   if (!db.openDb( true )) {
     return 1;
   }
 
-  db.emptyCatalog("@system");
-  db.writeStore( zypp->target()->resolvables(), ResStatus::installed, "@system", ZYPP_OWNED );
+  // only write what the last transaction installed or removed
+  //  installed packages are matched by NEVRA and install time
+  DBSyncCounts counts;
+  if (!rescan_system
+      && db.syncStore( zypp->target()->resolvables(), ResStatus::installed, "@system", ZYPP_OWNED, counts ))
+  {
+    MIL << "Catalog '@system': " << counts.added << " added, " << counts.updated << " updated, "
+        << counts.removed << " removed, " << counts.kept << " kept" << endl;
+  }
+  else
+  {
+    MIL << "Rescanning @system" << endl;
+    db.emptyCatalog("@system");
+    db.writeStore( zypp->target()->resolvables(), ResStatus::installed, "@system", ZYPP_OWNED );
+  }
   db.closeDb();
 
   MIL << "END parse-metadata @system, result 0" << endl;
@@ -99,9 +208,42 @@ static int
 sync_source( DbAccess & db, Source_Ref source, const string & catalog, const Url & url, Ownership owner )
 {
   int result = 0;
+  bool staged = false;
+  DbAccess_Ptr shard;		// the catalogs db file, if sharded
+  DbAccess *target = &db;	// where resolvables go
   DBG << "sync_source, catalog '" << catalog << "', url '" << url << "', alias '" << source.alias() << ", owner " << owner << endl;
   try
   {
+    // metadata unchanged since the last successful write, nothing to do
+    string checksum = source.checksum();
+    DBCatalogEntry entry = db.getCatalogEntry( catalog );
+    if (!checksum.empty()
+        && entry.checksum == checksum
+        && entry.resolvables > 0)		// else a write failed or the rows were dropped
+    {
+      MIL << "Catalog '" << catalog << "' unchanged (checksum " << checksum << "), keeping " << entry.resolvables << " resolvables" << endl;
+      for (map<RCDependencyTarget, unsigned>::const_iterator it = entry.kind_counts.begin(); it != entry.kind_counts.end(); ++it)
+        DBG << "  kind " << it->first << ": " << it->second << endl;
+      if (!url.getScheme().empty())
+        source.setUrl( url );
+      return 0;
+    }
+
+    // same metadata already written for another catalog (a mirror), use its rows
+    if (share_catalogs
+        && db.shareCatalog( catalog, checksum, owner ))
+    {
+      db.updateCatalogChecksum( catalog, checksum, source.timestamp() );
+      if (!url.getScheme().empty())
+        source.setUrl( url );
+      return 0;
+    }
+
+    // don't keep main locked while parsing, the read above holds a shared lock
+    //  and writes so far (catalog entry) a reserved one
+    db.commit();
+    db.begin();
+
     ResStore store = source.resolvables();
     if (!url.getScheme().empty())
     {
@@ -113,12 +255,57 @@ sync_source( DbAccess & db, Source_Ref source, const string & catalog, const Url
 
     // clean up db if we fail here
     result = 1;
-    
-    // FIXME add the smart algorithm here
-    db.emptyCatalog(catalog);
-    db.writeStore( store, ResStatus::uninstalled, catalog.c_str(), owner );	// store all resolvables as 'uninstalled'
-    db.updateCatalogChecksum( catalog, source.checksum(), source.timestamp() );
-    result = 0;
+
+    if (shard_catalogs)
+    {
+      shard = db.openShard( catalog );
+      if (!shard)
+      {
+        ERR << "Can't open shard of catalog '" << catalog << "'" << endl;
+        cerr << "1|Can't open database of catalog " << catalog << endl;
+        target = NULL;
+      }
+      else
+        target = &*shard;
+    }
+
+    // staged: write the whole catalog aside and swap it in at the end,
+    // the live catalog stays untouched if anything fails
+    staged = target && stage_refresh && target->beginStaging();
+
+    // the stored checksum only vouches for a completely written catalog
+    //  staged in main, commitStaging() clears it along with the swap
+    if (!entry.checksum.empty()
+        && !(staged && target == &db))
+    {
+      db.updateCatalogChecksum( catalog, "", source.timestamp() );
+    }
+    db.commit();			// durable before the rows change, main not locked while writing a shard
+    db.begin();
+
+    // only write what changed since the last refresh
+    DBSyncCounts counts;
+    if (target
+        && target->syncStore( store, ResStatus::uninstalled, catalog.c_str(), owner, counts ))	// store all resolvables as 'uninstalled'
+    {
+      if (staged)
+      {
+        MIL << "Catalog '" << catalog << "': " << counts.added << " staged" << endl;
+        if (target->commitStaging( catalog ))
+          result = 0;
+      }
+      else
+      {
+        MIL << "Catalog '" << catalog << "': " << counts.added << " added, " << counts.updated << " updated, "
+            << counts.removed << " removed, " << counts.kept << " kept" << endl;
+        result = 0;
+      }
+      if (result == 0)
+      {
+        db.updateCatalogChecksum( catalog, checksum, source.timestamp() );
+        db.setCatalogContent( catalog, catalog, owner );
+      }
+    }
   }
   catch ( const Exception & excpt_r ) {
     ZYPP_CAUGHT( excpt_r );
@@ -127,25 +314,24 @@ sync_source( DbAccess & db, Source_Ref source, const string & catalog, const Url
     // the db untouched.
   }
 
-  if (result != 0) {	// failed in db.writeStore(), see #189308
+  if (staged) {		// nothing written to the live catalog on failure
+    target->abortStaging();
+  }
+  if (shard) {
+    shard->closeDb();
+  }
+  if (!staged && result != 0) {	// failed in db.syncStore(), see #189308
     ERR << "Write to database failed, cleaning up" << endl;
     db.emptyCatalog( catalog.c_str() );
   }
   return result;
 }
 
+// find or create the source of one catalog and write it to db (open for writing)
+
 static int
-parse_metadata( Ownership owner, const std::string &p_dbfile, const std::string &p_path, const std::string &p_url, const std::string &p_catalog )
+parse_catalog( DbAccess & db, Ownership owner, const std::string &p_path, const std::string &p_url, const std::string &p_catalog )
 {
-  DbAccess db( p_dbfile );		// the zmd.db
-
-  if (!db.openDb( true ))		// open for writing
-  {
-    cerr << "1|Cannot open database " << p_dbfile << endl;
-    ERR << "Cannot open database" << endl;
-    return 1;
-  }
-
     // check for "...;alias=..." and replace with "...&alias=..." (#168030)
   string checkpath ( p_url );
   string::size_type aliaspos = checkpath.find( ";alias=" );
@@ -304,27 +490,120 @@ parse_metadata( Ownership owner, const std::string &p_dbfile, const std::string
     }
 finish:
 
-    db.closeDb();
-
-    MIL << "END parse-metadata, result " << result << endl;
+    MIL << "END parse-metadata " << p_catalog << ", result " << result << endl;
 
     return result;
 }
 
+static int
+parse_metadata( Ownership owner, const std::string &p_dbfile, const std::string &p_path, const std::string &p_url, const std::string &p_catalog )
+{
+  DbAccess db( p_dbfile );		// the zmd.db
+  configure_db( db );
 
-//----------------------------------------------------------------------------
+  if (!db.openDb( true ))		// open for writing
+  {
+    cerr << "1|Cannot open database " << p_dbfile << endl;
+    ERR << "Cannot open database" << endl;
+    return 1;
+  }
+
+  int result = parse_catalog( db, owner, p_path, p_url, p_catalog );
+
+  db.closeDb();
+
+  return result;
+}
 
 // metadata owners
 #define SYSTEM "system"
 #define ZYPP "zypp"
 #define ZMD "yum"	// zmd claims "yum" for itself
 
+#define BATCH "--batch"
+
+// refresh all catalogs listed in batchfile ("-" for stdin) with one zypp
+//  instance and one db connection, one catalog per line as
+//  <owner> <uri> <path> <catalog id>
+//  Failed catalogs are reported and skipped, result is 1 if any failed.
+
+static int
+parse_batch( const std::string &p_dbfile, const std::string &p_batchfile )
+{
+  ifstream file;
+  istream *in = &cin;
+  if (p_batchfile != "-")
+  {
+    file.open( p_batchfile.c_str() );
+    if (!file)
+    {
+      cerr << "1|Cannot read " << p_batchfile << endl;
+      ERR << "Cannot read " << p_batchfile << endl;
+      return 1;
+    }
+    in = &file;
+  }
+
+  DbAccess db( p_dbfile );		// the zmd.db
+  configure_db( db );
+
+  if (!db.openDb( true ))		// open for writing
+  {
+    cerr << "1|Cannot open database " << p_dbfile << endl;
+    ERR << "Cannot open database" << endl;
+    return 1;
+  }
+
+  int result = 0;
+  unsigned catalogs = 0;
+  string line;
+  while (getline( *in, line ))
+  {
+    istringstream fields( line );
+    string owned_by, uri, path, catalog;
+    if (!(fields >> owned_by)
+        || owned_by[0] == '#')
+    {
+      continue;
+    }
+    if (!(fields >> uri >> path >> catalog)
+        || (owned_by != ZYPP && owned_by != ZMD))
+    {
+      cerr << "1|Bad batch line '" << line << "'" << endl;
+      ERR << "Bad batch line '" << line << "'" << endl;
+      result = 1;
+      continue;
+    }
+
+    MIL << "Batch catalog " << catalog << " (" << owned_by << " " << uri << " " << path << ")" << endl;
+    ++catalogs;
+    if (parse_catalog( db, (owned_by == ZMD) ? ZMD_OWNED : ZYPP_OWNED, uri, path, catalog ) != 0)
+      result = 1;
+
+    // each catalog in a transaction of its own, durable once done
+    if (!db.commit())
+      result = 1;
+    db.begin();
+  }
+
+  db.closeDb();
+
+  MIL << "END parse-metadata batch, " << catalogs << " catalogs, result " << result << endl;
+
+  return result;
+}
+
+
+//----------------------------------------------------------------------------
+
 int
 main (int argc, char **argv)
 {
-    if (argc < 6)
+    bool batch = (argc == 4 && string( argv[2] ) == BATCH);
+    if (argc < 6 && !batch)
     {
       cerr << "1|usage: " << argv[0] << " <database> <owner> <uri> <path> <catalog id>" << endl;
+      cerr << "1|       " << argv[0] << " <database> " << BATCH << " <file>" << endl;
       return 1;
     }
 
@@ -335,6 +614,16 @@ main (int argc, char **argv)
       zypp::base::LogControl::instance().logfile( ZMD_BACKEND_LOG );
 
     MIL << "-------------------------------------" << endl;
+    if (batch)
+    {
+      MIL << "START parse-metadata " << argv[1] << " " << argv[2] << " " << argv[3] << endl;
+      ZYpp::Ptr God = backend::getZYpp( true );
+      KeyRingCallbacks keyring_callbacks;
+      DigestCallbacks digest_callbacks;
+      backend::initTarget( God );
+      return parse_batch( argv[1] /* zmd db */, argv[3] /* batch file */ );
+    }
+
     //                                     database    owner               uri                path            catalog
     MIL << "START parse-metadata " << argv[1] << " " << argv[2] << " " << argv[3] << " " << argv[4] << " " << argv[5] << endl;
 
@@ -32,6 +32,7 @@ using namespace zypp;
 
 #include "dbsource/DbAccess.h"
 #include "dbsource/DbSources.h"
+#include "dbsource/DbStatementCache.h"
 
 typedef enum {
   /**
@@ -404,10 +405,8 @@ write_transactions (const ResPool & pool, sqlite3 *db, ResolverContext_Ptr conte
 void
 drop_transaction (sqlite3 *db, sqlite_int64 id)
 {
-  sqlite3_stmt *handle = NULL;
-  const char *sql = "DELETE FROM transactions WHERE id = ?";
-  int rc = sqlite3_prepare( db, sql, -1, &handle, NULL );
-  if (rc != SQLITE_OK)
+  sqlite3_stmt *handle = DbStatementCache::of( db ).get( "DELETE FROM transactions WHERE id = ?" );
+  if (handle == NULL)
   {
     ERR << "Can not prepare transaction delete clause: " << sqlite3_errmsg (db) << endl;
     return;
@@ -415,7 +414,7 @@ drop_transaction (sqlite3 *db, sqlite_int64 id)
 
   sqlite3_bind_int64( handle, 1, id );
 
-  rc = sqlite3_step( handle );
+  int rc = sqlite3_step( handle );
   if (rc != SQLITE_DONE)
   {
     ERR << "Can not remove transaction: " << sqlite3_errmsg (db) << endl;
@@ -0,0 +1,170 @@
+//
+// depblob.cc
+//
+// test DbDependencyBlob: encode/decode round trip and
+// decoding of damaged or random blobs (must fail cleanly, never crash)
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/dbsource/DbDependencyBlob.h"
+
+using namespace std;
+
+#define ROUNDS 20000
+
+// deterministic pseudo random numbers, runs must be reproducible
+
+static unsigned long long seed = 42;
+
+static unsigned
+rnd( unsigned range )
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(seed >> 33) % range;
+}
+
+static string
+rnd_string( unsigned maxlen )
+{
+    string s;
+    unsigned len = rnd( maxlen + 1 );
+    for (unsigned i = 0; i < len; ++i)
+	s += (char)rnd( 256 );
+    return s;
+}
+
+static void
+rnd_rows( vector<DbDependencyRow> & rows )
+{
+    rows.clear();
+    unsigned count = rnd( 40 );
+    for (unsigned i = 0; i < count; ++i) {
+	DbDependencyRow row;
+	row.dep_type = rnd( 10 );
+	row.dep_target = rnd( 12 );
+	row.relation = (int)rnd( 10 ) - 1;
+	row.arch = (rnd( 2 ) == 0) ? -1 : (int)rnd( 16 );
+	if (rnd( 2 ) == 0)
+	    row.name_id = 1 + rnd( 1000000 ) * (sqlite_int64)rnd( 100000 );
+	else
+	    row.name = rnd_string( 60 );
+	row.versioned = (rnd( 2 ) == 0);
+	if (row.versioned) {
+	    row.epoch = (rnd( 4 ) == 0) ? (int)rnd( 100 ) : 0;
+	    row.version = rnd_string( 20 );
+	    row.release = rnd_string( 20 );
+	}
+	rows.push_back( row );
+    }
+}
+
+static bool
+same( const DbDependencyRow & a, const DbDependencyRow & b )
+{
+    return a.dep_type == b.dep_type
+	&& a.dep_target == b.dep_target
+	&& a.relation == b.relation
+	&& a.arch == b.arch
+	&& a.name_id == b.name_id
+	&& a.name == b.name
+	&& a.versioned == b.versioned
+	&& a.epoch == b.epoch
+	&& a.version == b.version
+	&& a.release == b.release;
+}
+
+// decoding must succeed for blobs we wrote and reproduce the rows
+
+static int
+roundtrip()
+{
+    vector<DbDependencyRow> rows, decoded;
+    for (unsigned i = 0; i < ROUNDS; ++i) {
+	rnd_rows( rows );
+	string blob;
+	dep_blob_encode( rows, blob );
+	if (!dep_blob_decode( blob.data(), blob.size(), decoded ))
+	    return 1;
+	if (decoded.size() != rows.size())
+	    return 2;
+	for (unsigned r = 0; r < rows.size(); ++r) {
+	    if (!same( rows[r], decoded[r] ))
+		return 3;
+	}
+    }
+    return 0;
+}
+
+// damaged blobs: either rejected, or decoded into rows which encode to a valid blob again
+
+static int
+fuzz()
+{
+    vector<DbDependencyRow> rows, decoded, again;
+    for (unsigned i = 0; i < ROUNDS; ++i) {
+	rnd_rows( rows );
+	string blob;
+	dep_blob_encode( rows, blob );
+
+	switch (rnd( 4 )) {
+	    case 0:		// flip some bytes
+		for (unsigned n = 1 + rnd( 4 ); n > 0 && !blob.empty(); --n)
+		    blob[rnd( blob.size() )] ^= (char)(1 + rnd( 255 ));
+		break;
+	    case 1:		// truncate
+		blob.resize( rnd( blob.size() + 1 ) );
+		break;
+	    case 2:		// trailing garbage
+		blob += rnd_string( 16 ) + "x";
+		break;
+	    default:		// noise with a valid format byte
+		blob = (char)DEP_BLOB_FORMAT + rnd_string( 200 );
+		break;
+	}
+
+	if (dep_blob_decode( blob.data(), blob.size(), decoded )) {
+	    string blob2;
+	    dep_blob_encode( decoded, blob2 );
+	    if (!dep_blob_decode( blob2.data(), blob2.size(), again )
+		|| again.size() != decoded.size())
+		return 10;
+	}
+	else if (!decoded.empty()) {
+	    return 11;			// failed decode must not leave rows behind
+	}
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    vector<DbDependencyRow> rows;
+
+    // edge cases
+    if (dep_blob_decode( NULL, 0, rows )) return 20;
+    if (dep_blob_decode( "", 0, rows )) return 21;
+    string empty;
+    dep_blob_encode( rows, empty );
+    if (!dep_blob_decode( empty.data(), empty.size(), rows ) || !rows.empty()) return 22;
+    string future( empty );
+    future[0] = (char)(DEP_BLOB_FORMAT + 1);
+    if (dep_blob_decode( future.data(), future.size(), rows )) return 23;
+    const char huge[] = { DEP_BLOB_FORMAT, (char)0xff, (char)0xff, (char)0xff, (char)0xff, 0x0f };
+    if (dep_blob_decode( huge, sizeof(huge), rows )) return 24;
+
+    int result = roundtrip();
+    if (result != 0) {
+	cerr << "round trip failed: " << result << endl;
+	return result;
+    }
+    result = fuzz();
+    if (result != 0) {
+	cerr << "fuzzing failed: " << result << endl;
+	return result;
+    }
+    return 0;
+}
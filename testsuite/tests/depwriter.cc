@@ -0,0 +1,105 @@
+//
+// depwriter.cc
+//
+// benchmark DbDependencyWriter: dependency rows per second
+// written row by row (width 1, the old way) and batched
+//
+
+#include <sys/time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <iostream>
+
+#include <zypp/base/Logger.h>
+#include "src/dbsource/DbDependencyWriter.h"
+
+using namespace std;
+
+#define ROWS 200000
+
+static double
+now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// write ROWS rows with the given batch width, return rows per second (< 0 on error)
+
+static double
+run( const char *dbfile, unsigned width )
+{
+    unlink( dbfile );
+
+    sqlite3 *db = NULL;
+    if (sqlite3_open( dbfile, &db ) != SQLITE_OK)
+	return -1;
+
+    sqlite3_exec( db, "PRAGMA synchronous = 0", NULL, NULL, NULL );
+    sqlite3_exec( db, "CREATE TABLE dependencies (id INTEGER PRIMARY KEY, resolvable_id INTEGER, dep_type INTEGER,"
+		  " name VARCHAR, version VARCHAR, release VARCHAR, epoch INTEGER, arch INTEGER,"
+		  " relation INTEGER, dep_target INTEGER, name_id INTEGER)", NULL, NULL, NULL );
+    sqlite3_exec( db, "CREATE INDEX dependency_resolvable_index ON dependencies (resolvable_id)", NULL, NULL, NULL );
+    sqlite3_exec( db, "BEGIN", NULL, NULL, NULL );
+
+    DbDependencyWriter writer( width );
+    if (!writer.prepare( db )) {
+	sqlite3_close( db );
+	return -1;
+    }
+
+    char name[32];
+    DbDependencyRow row;
+    double start = now();
+
+    for (unsigned i = 0; i < ROWS; ++i) {
+	row.resolvable_id = i / 20 + 1;
+	row.dep_type = i % 10;
+	snprintf( name, sizeof(name), "lib%u.so.%u", i % 1000, i % 7 );
+	row.name = name;
+	row.versioned = (i % 3 == 0);
+	row.version = "1.2.3";
+	row.release = "4";
+	writer.add( row );
+    }
+    writer.close();
+    sqlite3_exec( db, "COMMIT", NULL, NULL, NULL );
+
+    double elapsed = now() - start;
+
+    // check that nothing got lost
+    sqlite3_stmt *handle = NULL;
+    sqlite3_prepare( db, "SELECT COUNT(*) FROM dependencies", -1, &handle, NULL );
+    int count = -1;
+    if (handle && sqlite3_step( handle ) == SQLITE_ROW)
+	count = sqlite3_column_int( handle, 0 );
+    sqlite3_finalize( handle );
+    sqlite3_close( db );
+    unlink( dbfile );
+
+    if (count != ROWS || writer.written() != ROWS) {
+	cerr << "width " << width << ": wrote " << count << " rows, expected " << ROWS << endl;
+	return -1;
+    }
+
+    return (elapsed > 0) ? ROWS / elapsed : ROWS;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *dbfile = "/tmp/depwriter.db";
+
+    double before = run( dbfile, 1 );
+    double after = run( dbfile, DbDependencyWriter::DEFAULT_WIDTH );
+
+    if (before < 0 || after < 0)
+	return 1;
+
+    cout << "row by row: " << (unsigned long)before << " rows/s" << endl;
+    cout << "batched (" << DbDependencyWriter::DEFAULT_WIDTH << "): " << (unsigned long)after << " rows/s" << endl;
+    MIL << "depwriter: " << (unsigned long)before << " -> " << (unsigned long)after << " rows/s" << endl;
+
+    return 0;
+}